@@ -20,16 +20,67 @@
 #include "api/sb-api.h"
 #include "sb-common.h"
 
+/* state needed to answer the caller once the target plugin responded */
+struct result_context {
+  uint64_t callid;
+  uint64_t con_id;
+  uint32_t msgid;
+};
+
+static void api_result_response_cb(struct callinfo *cinfo, void *data)
+{
+  struct result_context *ctx = data;
+  struct api_error api_error = ERROR_INIT;
+  array result_response_params;
+
+  if (cinfo->errorresponse || cinfo->response.params.size != 1) {
+    error_set(&api_error, API_ERROR_TYPE_VALIDATION,
+        "Error dispatching result API response. Either response is broken "
+        "or it just has wrong params size.");
+    goto fail;
+  }
+
+  if (!(cinfo->response.params.obj[0].type == OBJECT_TYPE_UINT &&
+    ctx->callid == cinfo->response.params.obj[0].data.uinteger)) {
+    error_set(&api_error, API_ERROR_TYPE_VALIDATION,
+        "Error dispatching run API response. Invalid callid");
+    goto fail;
+  }
+
+  result_response_params.size = 1;
+  result_response_params.obj = CALLOC(1, struct message_object);
+
+  if (!result_response_params.obj)
+    goto fail;
+
+  result_response_params.obj[0].type = OBJECT_TYPE_UINT;
+  result_response_params.obj[0].data.uinteger = ctx->callid;
+
+  connection_send_response(ctx->con_id, ctx->msgid, result_response_params,
+      &api_error);
+
+  FREE(ctx);
+
+  return;
+
+fail:
+  if (!api_error.isset)
+    error_set(&api_error, API_ERROR_TYPE_VALIDATION,
+        "Error executing result API request.");
+
+  connection_send_error_response(ctx->con_id, ctx->msgid, &api_error);
+  FREE(ctx);
+}
+
 int api_result(char *targetpluginkey, uint64_t callid,
     struct message_object args, uint64_t con_id, uint32_t msgid,
     struct api_error *api_error)
 {
   struct message_object *data;
   struct message_object *meta;
+  struct result_context *ctx;
   array result_params;
-  array result_response_params;
   string result;
-  struct callinfo cinfo;
 
   if (!api_error)
     return (-1);
@@ -57,44 +108,29 @@ int api_result(char *targetpluginkey, uint64_t callid,
   data->type = OBJECT_TYPE_UINT;
   data->data.uinteger = callid;
 
-  /* add function parameters, data refs to third result_params parameter */
-  data = &result_params.obj[1];
-
-  data->type = OBJECT_TYPE_ARRAY;
-  data->data.params = message_object_copy(args).data.params;
+  /* add function parameters, encoded or not, as second result_params
+     parameter. They are borrowed from the request, which outlives the send. */
+  result_params.obj[1] = message_object_borrow(args);
 
-  /* send request */
-  result = (string) {.str = "result", .length = sizeof("result") - 1};
-  cinfo = connection_send_request(targetpluginkey, result, result_params,
-      api_error);
-
-  if (api_error->isset)
-    return (-1);
+  ctx = MALLOC(struct result_context);
 
-  if (cinfo.response.params.size != 1) {
-    error_set(api_error, API_ERROR_TYPE_VALIDATION,
-        "Error dispatching result API response. Either response is broken "
-        "or it just has wrong params size.");
+  if (!ctx) {
+    free_params(result_params);
     return (-1);
   }
 
-  if (!(cinfo.response.params.obj[0].type == OBJECT_TYPE_UINT &&
-    callid == cinfo.response.params.obj[0].data.uinteger)) {
-    error_set(api_error, API_ERROR_TYPE_VALIDATION,
-        "Error dispatching run API response. Invalid callid");
-    return (-1);
-  }
+  ctx->callid = callid;
+  ctx->con_id = con_id;
+  ctx->msgid = msgid;
 
-  result_response_params.size = 1;
-  result_response_params.obj = CALLOC(1, struct message_object);
-  result_response_params.obj[0].type = OBJECT_TYPE_UINT;
-  result_response_params.obj[0].data.uinteger = callid;
+  /* send request, the caller gets its response in api_result_response_cb() */
+  result = (string) {.str = "result", .length = sizeof("result") - 1};
 
-  if (connection_send_response(con_id, msgid, result_response_params, api_error) < 0) {
+  if (connection_send_request(targetpluginkey, result, result_params,
+      api_result_response_cb, ctx, api_error) == -1) {
+    FREE(ctx);
     return (-1);
-  };
-
-  free_params(cinfo.response.params);
+  }
 
   return (0);
 }
@@ -18,18 +18,70 @@
 #include <stddef.h>
 
 #include "rpc/db/sb-db.h"
+#include "rpc/msgpack/sb-msgpack-rpc.h"
 #include "api/sb-api.h"
 
+/* state needed to answer the caller once the target plugin responded */
+struct run_context {
+  uint64_t callid;
+  uint64_t con_id;
+  uint32_t msgid;
+};
+
+static void api_run_response_cb(struct callinfo *cinfo, void *data)
+{
+  struct run_context *ctx = data;
+  struct api_error api_error = ERROR_INIT;
+  array run_response_params;
+
+  if (cinfo->errorresponse || cinfo->response.params.size != 1) {
+    error_set(&api_error, API_ERROR_TYPE_VALIDATION,
+        "Error dispatching run API response. Either response is broken "
+        "or it just has wrong params size.");
+    goto fail;
+  }
+
+  if (!(cinfo->response.params.obj[0].type == OBJECT_TYPE_UINT &&
+    ctx->callid == cinfo->response.params.obj[0].data.uinteger)) {
+    error_set(&api_error, API_ERROR_TYPE_VALIDATION,
+        "Error dispatching run API response. Invalid callid");
+    goto fail;
+  }
+
+  run_response_params.size = 1;
+  run_response_params.obj = CALLOC(1, struct message_object);
+
+  if (!run_response_params.obj)
+    goto fail;
+
+  run_response_params.obj[0].type = OBJECT_TYPE_UINT;
+  run_response_params.obj[0].data.uinteger = ctx->callid;
+
+  connection_send_response(ctx->con_id, ctx->msgid, run_response_params,
+      &api_error);
+
+  FREE(ctx);
+
+  return;
+
+fail:
+  if (!api_error.isset)
+    error_set(&api_error, API_ERROR_TYPE_VALIDATION,
+        "Error executing run API request.");
+
+  connection_send_error_response(ctx->con_id, ctx->msgid, &api_error);
+  FREE(ctx);
+}
+
 int api_run(char *targetpluginkey, string function_name, uint64_t callid,
     struct message_object args, uint64_t con_id,
     uint32_t msgid, struct api_error *api_error)
 {
   struct message_object *data;
   struct message_object *meta;
-  array run_params;
-  array run_response_params;
+  struct run_context *ctx;
+  array run_params, headers = ARRAY_INIT, *argv;
   string run;
-  struct callinfo cinfo;
 
   if (!api_error)
     return (-1);
@@ -39,12 +91,27 @@ int api_run(char *targetpluginkey, string function_name, uint64_t callid,
     return (-1);
   }
 
-  if (db_function_verify(targetpluginkey, function_name, &args.data.params) == -1) {
+  /* encoded arguments are checked by the headers of their elements */
+  if (args.type == OBJECT_TYPE_RAW) {
+    if (unpack_raw_params(args.data.string, &headers) == -1) {
+      error_set(api_error, API_ERROR_TYPE_VALIDATION,
+          "run() arguments are invalid.");
+      return (-1);
+    }
+
+    argv = &headers;
+  } else
+    argv = &args.data.params;
+
+  if (db_function_verify(targetpluginkey, function_name, argv) == -1) {
+    free_params(headers);
     error_set(api_error, API_ERROR_TYPE_VALIDATION,
         "run() verification failed.");
     return (-1);
   }
 
+  free_params(headers);
+
   run_params.size = 3;
   run_params.obj = CALLOC(3, struct message_object);
 
@@ -77,44 +144,29 @@ int api_run(char *targetpluginkey, string function_name, uint64_t callid,
   data->type = OBJECT_TYPE_STR;
   data->data.string = cstring_copy_string(function_name.str);
 
-  /* add function parameters, data refs to third run_params parameter */
-  data = &run_params.obj[2];
+  /* add function parameters, encoded or not, as third run_params parameter.
+     They are borrowed from the request, which outlives the send. */
+  run_params.obj[2] = message_object_borrow(args);
 
-  data->type = OBJECT_TYPE_ARRAY;
-  data->data.params = message_object_copy(args).data.params;
+  ctx = MALLOC(struct run_context);
 
-  /* send request */
-  run = (string) {.str = "run", .length = sizeof("run") - 1};
-  cinfo = connection_send_request(targetpluginkey, run, run_params,
-      api_error);
-
-  if (api_error->isset)
-    return (-1);
-
-  if (cinfo.response.params.size != 1) {
-    error_set(api_error, API_ERROR_TYPE_VALIDATION,
-        "Error dispatching run API response. Either response is broken "
-        "or it just has wrong params size.");
+  if (!ctx) {
+    free_params(run_params);
     return (-1);
   }
 
-  if (!(cinfo.response.params.obj[0].type == OBJECT_TYPE_UINT &&
-    callid == cinfo.response.params.obj[0].data.uinteger)) {
-    error_set(api_error, API_ERROR_TYPE_VALIDATION,
-        "Error dispatching run API response. Invalid callid");
-    return (-1);
-  }
+  ctx->callid = callid;
+  ctx->con_id = con_id;
+  ctx->msgid = msgid;
 
-  run_response_params.size = 1;
-  run_response_params.obj = CALLOC(1, struct message_object);
-  run_response_params.obj[0].type = OBJECT_TYPE_UINT;
-  run_response_params.obj[0].data.uinteger = callid;
+  /* send request, the caller gets its response in api_run_response_cb() */
+  run = (string) {.str = "run", .length = sizeof("run") - 1};
 
-  if (connection_send_response(con_id, msgid, run_response_params, api_error) < 0) {
+  if (connection_send_request(targetpluginkey, run, run_params,
+      api_run_response_cb, ctx, api_error) == -1) {
+    FREE(ctx);
     return (-1);
-  };
-
-  free_params(cinfo.response.params);
+  }
 
   return (0);
 }
@@ -38,7 +38,8 @@
      uint32_t msgid, char *pluginkey, struct api_error *api_error);
 
 /**
- * Run a plugin function
+ * Run a plugin function. The run request is forwarded to the target plugin
+ * and the caller is answered as soon as the target plugin responded.
  * @param[in] targetpluginkey    pluginkey of the plugin to start
  * @param[in] function_name      function of the plugin
  * @param[in] args    function arguments of the plugin
@@ -0,0 +1,185 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * An arena hands out memory for the objects of one message from chunks by
+ * bumping a pointer. Nothing is freed on its own, all chunks are freed at
+ * once by arena_free(). The size of the first chunk is taken from a
+ * histogram of the sizes earlier arenas of the same kind grew to, so that
+ * most messages need a single malloc().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sb-common.h"
+#include "arena.h"
+
+struct arena_chunk {
+  struct arena_chunk *next;
+  size_t size;
+};
+
+arena *arena_new(struct arena_histogram *sizes)
+{
+  struct arena_chunk *chunk;
+  arena *ar;
+  size_t header = ARENA_ROUNDUP(sizeof(struct arena_chunk)) +
+      ARENA_ROUNDUP(sizeof(arena));
+  size_t size = sizes ? arena_histogram_size(sizes) : ARENA_MIN_SIZE;
+
+  /* the arena lives in its first chunk */
+  chunk = malloc(header + size);
+
+  if (!chunk)
+    return (NULL);
+
+  chunk->next = NULL;
+  chunk->size = size;
+
+  ar = (arena *)((unsigned char *)chunk +
+      ARENA_ROUNDUP(sizeof(struct arena_chunk)));
+  ar->sizes = sizes;
+  ar->chunks = chunk;
+  ar->nchunks = 1;
+  ar->next = (unsigned char *)chunk + header;
+  ar->left = size;
+  ar->used = 0;
+
+  return (ar);
+}
+
+
+void *arena_alloc(arena *ar, size_t size)
+{
+  void *ret;
+
+  if (size > SIZE_MAX - ARENA_ALIGN)
+    return (NULL);
+
+  size = ARENA_ROUNDUP(MAX(size, 1));
+
+  if (PREDICT_UNLIKELY(size > ar->left) && arena_grow(ar, size) != 0)
+    return (NULL);
+
+  ret = ar->next;
+  ar->next += size;
+  ar->left -= size;
+  ar->used += size;
+
+  return (ret);
+}
+
+
+void *arena_calloc(arena *ar, size_t nmemb, size_t size)
+{
+  void *ret;
+
+  if (size && nmemb > SIZE_MAX / size)
+    return (NULL);
+
+  ret = arena_alloc(ar, nmemb * size);
+
+  if (ret)
+    memset(ret, 0, nmemb * size);
+
+  return (ret);
+}
+
+
+void arena_free(arena *ar)
+{
+  struct arena_chunk *chunk, *next;
+
+  if (!ar)
+    return;
+
+  if (ar->sizes)
+    arena_histogram_add(ar->sizes, ar->used);
+
+  /* the first chunk, which holds the arena, is the last in the list */
+  for (chunk = ar->chunks; chunk; chunk = next) {
+    next = chunk->next;
+    free(chunk);
+  }
+}
+
+
+/* adds a chunk with room for at least `size` bytes, twice the last one */
+STATIC int arena_grow(arena *ar, size_t size)
+{
+  struct arena_chunk *chunk, *last = ar->chunks;
+  size_t header = ARENA_ROUNDUP(sizeof(struct arena_chunk));
+
+  if (last->size <= (SIZE_MAX - header) / 2)
+    size = MAX(size, last->size * 2);
+
+  if (size > SIZE_MAX - header)
+    return (-1);
+
+  chunk = malloc(header + size);
+
+  if (!chunk)
+    return (-1);
+
+  chunk->next = ar->chunks;
+  chunk->size = size;
+  ar->chunks = chunk;
+  ar->nchunks++;
+  ar->next = (unsigned char *)chunk + header;
+  ar->left = size;
+
+  return (0);
+}
+
+
+/* the smallest bucket limit most of the recorded arenas fit into */
+STATIC size_t arena_histogram_size(struct arena_histogram *sizes)
+{
+  uint64_t count = 0;
+  uint64_t wanted = (sizes->total * ARENA_HISTOGRAM_PERCENTILE + 99) / 100;
+  size_t i;
+
+  for (i = 0; i < ARENA_HISTOGRAM_BUCKETS - 1; i++) {
+    count += sizes->counts[i];
+
+    if (count >= wanted)
+      break;
+  }
+
+  return ((size_t)ARENA_MIN_SIZE << i);
+}
+
+
+STATIC void arena_histogram_add(struct arena_histogram *sizes, size_t used)
+{
+  size_t i = 0;
+
+  while (i < ARENA_HISTOGRAM_BUCKETS - 1 && used > (size_t)ARENA_MIN_SIZE << i)
+    i++;
+
+  sizes->counts[i]++;
+
+  if (++sizes->total < ARENA_HISTOGRAM_WINDOW)
+    return;
+
+  sizes->total = 0;
+
+  for (i = 0; i < ARENA_HISTOGRAM_BUCKETS; i++) {
+    sizes->counts[i] /= 2;
+    sizes->total += sizes->counts[i];
+  }
+}
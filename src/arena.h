@@ -0,0 +1,32 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "sb-common.h"
+
+/* the smallest first chunk, also the limit of the first histogram bucket */
+#define ARENA_MIN_SIZE 0x100
+#define ARENA_ALIGN 16
+#define ARENA_ROUNDUP(x) (((x) + ARENA_ALIGN - 1) & ~((size_t)ARENA_ALIGN - 1))
+/* counts are halved after this many messages, recent sizes count more */
+#define ARENA_HISTOGRAM_WINDOW 1024
+/* share of the messages whose arena fits into the first chunk */
+#define ARENA_HISTOGRAM_PERCENTILE 90
+
+STATIC int arena_grow(arena *ar, size_t size);
+STATIC size_t arena_histogram_size(struct arena_histogram *sizes);
+STATIC void arena_histogram_add(struct arena_histogram *sizes, size_t used);
@@ -0,0 +1,362 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Curve25519 scalar multiplication for the crypto_box functions of
+ * tweetnacl. tweetnacl represents field elements as 16 limbs of 16 bit,
+ * which costs 256 multiplications per field multiplication. On 64 bit
+ * targets with 128 bit products we use 5 limbs of 51 bit instead
+ * (curve25519-donna-c64), which brings down the cost to 25.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sb-common.h"
+#include "tweetnacl.h"
+#include "curve25519.h"
+
+static const char *implementation = "tweetnacl";
+
+#ifdef __SIZEOF_INT128__
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+/* a field element, the value is sum(f[i] * 2^(51 * i)) */
+typedef uint64_t fe[5];
+
+#define MASK51 0x7ffffffffffffULL
+
+static uint64_t load64(const unsigned char *x)
+{
+  uint64_t u = 0;
+
+  for (int i = 7; i >= 0; i--)
+    u = (u << 8) | x[i];
+
+  return u;
+}
+
+static void store64(unsigned char *x, uint64_t u)
+{
+  for (int i = 0; i < 8; i++, u >>= 8)
+    x[i] = (unsigned char)u;
+}
+
+/* unpacks 255 bit little endian, the top bit is ignored */
+static void fe_frombytes(fe h, const unsigned char *s)
+{
+  h[0] = load64(s) & MASK51;
+  h[1] = (load64(s + 6) >> 3) & MASK51;
+  h[2] = (load64(s + 12) >> 6) & MASK51;
+  h[3] = (load64(s + 19) >> 1) & MASK51;
+  h[4] = (load64(s + 24) >> 12) & MASK51;
+}
+
+static void fe_carry(uint64_t t[5])
+{
+  t[1] += t[0] >> 51;
+  t[0] &= MASK51;
+  t[2] += t[1] >> 51;
+  t[1] &= MASK51;
+  t[3] += t[2] >> 51;
+  t[2] &= MASK51;
+  t[4] += t[3] >> 51;
+  t[3] &= MASK51;
+  t[0] += 19 * (t[4] >> 51);
+  t[4] &= MASK51;
+}
+
+/* packs the unique representative in [0, 2^255 - 19) */
+static void fe_tobytes(unsigned char *s, const fe h)
+{
+  uint64_t t[5];
+
+  memcpy(t, h, sizeof t);
+
+  fe_carry(t);
+  fe_carry(t);
+
+  /* t < 2^255 now, adding 19 carries into bit 255 iff t >= p */
+  t[0] += 19;
+  fe_carry(t);
+
+  /* add 2^255 - 19 and drop bit 255, which subtracts the 19 again or p */
+  t[0] += MASK51 + 1 - 19;
+  t[1] += MASK51;
+  t[2] += MASK51;
+  t[3] += MASK51;
+  t[4] += MASK51;
+
+  t[1] += t[0] >> 51;
+  t[0] &= MASK51;
+  t[2] += t[1] >> 51;
+  t[1] &= MASK51;
+  t[3] += t[2] >> 51;
+  t[2] &= MASK51;
+  t[4] += t[3] >> 51;
+  t[3] &= MASK51;
+  t[4] &= MASK51;
+
+  store64(s, t[0] | (t[1] << 51));
+  store64(s + 8, (t[1] >> 13) | (t[2] << 38));
+  store64(s + 16, (t[2] >> 26) | (t[3] << 25));
+  store64(s + 24, (t[3] >> 39) | (t[4] << 12));
+}
+
+static void fe_add(fe h, const fe f, const fe g)
+{
+  for (int i = 0; i < 5; i++)
+    h[i] = f[i] + g[i];
+}
+
+/* h = f - g, adds 4p so no limb goes negative */
+static void fe_sub(fe h, const fe f, const fe g)
+{
+  h[0] = f[0] + 0x3fffffffffff68ULL - g[0];
+  h[1] = f[1] + 0x3ffffffffffff8ULL - g[1];
+  h[2] = f[2] + 0x3ffffffffffff8ULL - g[2];
+  h[3] = f[3] + 0x3ffffffffffff8ULL - g[3];
+  h[4] = f[4] + 0x3ffffffffffff8ULL - g[4];
+}
+
+static void fe_reduce(fe h, uint128_t t[5])
+{
+  uint64_t c;
+
+  t[1] += (uint64_t)(t[0] >> 51);
+  h[0] = (uint64_t)t[0] & MASK51;
+  t[2] += (uint64_t)(t[1] >> 51);
+  h[1] = (uint64_t)t[1] & MASK51;
+  t[3] += (uint64_t)(t[2] >> 51);
+  h[2] = (uint64_t)t[2] & MASK51;
+  t[4] += (uint64_t)(t[3] >> 51);
+  h[3] = (uint64_t)t[3] & MASK51;
+  c = (uint64_t)(t[4] >> 51);
+  h[4] = (uint64_t)t[4] & MASK51;
+
+  h[0] += c * 19;
+  h[1] += h[0] >> 51;
+  h[0] &= MASK51;
+}
+
+static void fe_mul(fe h, const fe f, const fe g)
+{
+  uint128_t t[5];
+  uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+  uint64_t g0 = g[0], g1 = g[1], g2 = g[2], g3 = g[3], g4 = g[4];
+
+  t[0] = (uint128_t)f0 * g0;
+  t[1] = (uint128_t)f0 * g1 + (uint128_t)f1 * g0;
+  t[2] = (uint128_t)f0 * g2 + (uint128_t)f2 * g0 + (uint128_t)f1 * g1;
+  t[3] = (uint128_t)f0 * g3 + (uint128_t)f3 * g0 + (uint128_t)f1 * g2 +
+      (uint128_t)f2 * g1;
+  t[4] = (uint128_t)f0 * g4 + (uint128_t)f4 * g0 + (uint128_t)f3 * g1 +
+      (uint128_t)f1 * g3 + (uint128_t)f2 * g2;
+
+  /* 2^255 = 19 (mod p) */
+  f1 *= 19;
+  f2 *= 19;
+  f3 *= 19;
+  f4 *= 19;
+
+  t[0] += (uint128_t)f4 * g1 + (uint128_t)f1 * g4 + (uint128_t)f2 * g3 +
+      (uint128_t)f3 * g2;
+  t[1] += (uint128_t)f4 * g2 + (uint128_t)f2 * g4 + (uint128_t)f3 * g3;
+  t[2] += (uint128_t)f4 * g3 + (uint128_t)f3 * g4;
+  t[3] += (uint128_t)f4 * g4;
+
+  fe_reduce(h, t);
+}
+
+/* h = f^(2^count) */
+static void fe_sq(fe h, const fe f, int count)
+{
+  uint128_t t[5];
+  uint64_t f0 = f[0], f1 = f[1], f2 = f[2], f3 = f[3], f4 = f[4];
+  uint64_t d0, d1, d2, d4, d419;
+
+  do {
+    d0 = f0 * 2;
+    d1 = f1 * 2;
+    d2 = f2 * 2 * 19;
+    d419 = f4 * 19;
+    d4 = d419 * 2;
+
+    t[0] = (uint128_t)f0 * f0 + (uint128_t)d4 * f1 + (uint128_t)d2 * f3;
+    t[1] = (uint128_t)d0 * f1 + (uint128_t)d4 * f2 +
+        (uint128_t)f3 * (f3 * 19);
+    t[2] = (uint128_t)d0 * f2 + (uint128_t)f1 * f1 + (uint128_t)d4 * f3;
+    t[3] = (uint128_t)d0 * f3 + (uint128_t)d1 * f2 + (uint128_t)f4 * d419;
+    t[4] = (uint128_t)d0 * f4 + (uint128_t)d1 * f3 + (uint128_t)f2 * f2;
+
+    fe_reduce(h, t);
+
+    f0 = h[0];
+    f1 = h[1];
+    f2 = h[2];
+    f3 = h[3];
+    f4 = h[4];
+  } while (--count > 0);
+}
+
+static void fe_mul121665(fe h, const fe f)
+{
+  uint128_t t[5];
+
+  for (int i = 0; i < 5; i++)
+    t[i] = (uint128_t)f[i] * 121665;
+
+  fe_reduce(h, t);
+}
+
+/* swaps f and g if b is 1, in constant time */
+static void fe_cswap(fe f, fe g, uint64_t b)
+{
+  uint64_t mask = 0 - b, x;
+
+  for (int i = 0; i < 5; i++) {
+    x = mask & (f[i] ^ g[i]);
+    f[i] ^= x;
+    g[i] ^= x;
+  }
+}
+
+/* h = z^(p - 2) = 1 / z */
+static void fe_invert(fe h, const fe z)
+{
+  fe z2, z9, z11, z2_5_0, z2_10_0, z2_20_0, z2_50_0, z2_100_0, t;
+
+  fe_sq(z2, z, 1);
+  fe_sq(t, z2, 2);
+  fe_mul(z9, t, z);
+  fe_mul(z11, z9, z2);
+  fe_sq(t, z11, 1);
+  fe_mul(z2_5_0, t, z9);
+  fe_sq(t, z2_5_0, 5);
+  fe_mul(z2_10_0, t, z2_5_0);
+  fe_sq(t, z2_10_0, 10);
+  fe_mul(z2_20_0, t, z2_10_0);
+  fe_sq(t, z2_20_0, 20);
+  fe_mul(t, t, z2_20_0);
+  fe_sq(t, t, 10);
+  fe_mul(z2_50_0, t, z2_10_0);
+  fe_sq(t, z2_50_0, 50);
+  fe_mul(z2_100_0, t, z2_50_0);
+  fe_sq(t, z2_100_0, 100);
+  fe_mul(t, t, z2_100_0);
+  fe_sq(t, t, 50);
+  fe_mul(t, t, z2_50_0);
+  fe_sq(t, t, 5);
+  fe_mul(h, t, z11);
+}
+
+STATIC int curve25519_donna64(unsigned char *q, const unsigned char *n,
+    const unsigned char *p)
+{
+  unsigned char e[32];
+  fe x1, x2, z2, x3, z3;
+  fe a, aa, b, bb, c, d, da, cb, t;
+  uint64_t swap = 0, bit;
+
+  memcpy(e, n, sizeof e);
+  e[0] &= 248;
+  e[31] &= 127;
+  e[31] |= 64;
+
+  fe_frombytes(x1, p);
+  memset(x2, 0, sizeof x2);
+  memset(z2, 0, sizeof z2);
+  memset(z3, 0, sizeof z3);
+  memcpy(x3, x1, sizeof x3);
+  x2[0] = 1;
+  z3[0] = 1;
+
+  /* montgomery ladder, RFC 7748 section 5 */
+  for (int i = 254; i >= 0; i--) {
+    bit = (e[i >> 3] >> (i & 7)) & 1;
+    swap ^= bit;
+    fe_cswap(x2, x3, swap);
+    fe_cswap(z2, z3, swap);
+    swap = bit;
+
+    fe_add(a, x2, z2);
+    fe_sq(aa, a, 1);
+    fe_sub(b, x2, z2);
+    fe_sq(bb, b, 1);
+    fe_add(c, x3, z3);
+    fe_sub(d, x3, z3);
+    fe_mul(da, d, a);
+    fe_mul(cb, c, b);
+
+    fe_add(t, da, cb);
+    fe_sq(x3, t, 1);
+    fe_sub(t, da, cb);
+    fe_sq(t, t, 1);
+    fe_mul(z3, x1, t);
+
+    fe_mul(x2, aa, bb);
+    fe_sub(t, aa, bb);
+    fe_mul121665(a, t);
+    fe_add(a, a, aa);
+    fe_mul(z2, t, a);
+  }
+
+  fe_cswap(x2, x3, swap);
+  fe_cswap(z2, z3, swap);
+
+  fe_invert(z2, z2);
+  fe_mul(x2, x2, z2);
+  fe_tobytes(q, x2);
+
+  sbmemzero(e, sizeof e);
+  sbmemzero(x2, sizeof x2);
+  sbmemzero(z2, sizeof z2);
+  sbmemzero(x3, sizeof x3);
+  sbmemzero(z3, sizeof z3);
+
+  return 0;
+}
+
+void curve25519_init(void)
+{
+  crypto_scalarmult_impl = curve25519_donna64;
+  implementation = "donna64";
+
+  LOG_VERBOSE(VERBOSE_LEVEL_0, "using %s curve25519 implementation\n",
+      implementation);
+}
+
+#else
+
+STATIC int curve25519_donna64(unsigned char *q, const unsigned char *n,
+    const unsigned char *p)
+{
+  return crypto_scalarmult_ref(q, n, p);
+}
+
+void curve25519_init(void)
+{
+  LOG_VERBOSE(VERBOSE_LEVEL_0, "using %s curve25519 implementation\n",
+      implementation);
+}
+
+#endif /* __SIZEOF_INT128__ */
+
+const char *curve25519_implementation(void)
+{
+  return (implementation);
+}
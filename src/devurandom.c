@@ -16,16 +16,55 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <unistd.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#include "sb-common.h"
 
 static int fd = -1;
 
-void randombytes(unsigned char *x, unsigned long long xlen)
+/* reads from the kernel pool without a file descriptor, if available */
+static int getrandom_read(unsigned char *x, unsigned long long xlen)
+{
+#ifdef SYS_getrandom
+  long bytes_read;
+
+  while (xlen > 0) {
+    bytes_read = syscall(SYS_getrandom, x, xlen < 33554431 ? xlen : 33554431,
+        0);
+
+    if (bytes_read < 0) {
+      if (errno == EINTR)
+        continue;
+
+      return (-1);
+    }
+
+    x += bytes_read;
+    xlen -= (unsigned long long) bytes_read;
+  }
+
+  return (0);
+#else
+  (void)x;
+  (void)xlen;
+
+  return (-1);
+#endif
+}
+
+void devurandom_read(unsigned char *x, unsigned long long xlen)
 {
   size_t nbytes;
   ssize_t bytes_read;
 
+  if (getrandom_read(x, xlen) == 0)
+    return;
+
   if (fd == -1) {
     for (;;) {
       fd = open("/dev/urandom", O_RDONLY);
@@ -0,0 +1,183 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * randombytes() draws from a per-thread ChaCha20 generator with fast key
+ * erasure (D. J. Bernstein): every refill computes a few blocks of
+ * keystream, the first 32 bytes replace the key and the rest is handed
+ * out and wiped as it is consumed. Past outputs can't be recomputed from
+ * the state of the generator.
+ *
+ * The key is seeded from the kernel and reseeded after DRBG_RESEED_BYTES
+ * of output and in the child after a fork().
+ */
+
+#include <pthread.h>
+
+#include "sb-common.h"
+#include "tweetnacl.h"
+#include "drbg.h"
+
+#define DRBG_BUFFER_SIZE (DRBG_BLOCK_SIZE * 12)
+#define DRBG_RESEED_BYTES (1 << 20)
+
+#define ROTL32(v, n) ((uint32_t)(((v) << (n)) | ((v) >> (32 - (n)))))
+
+#define QUARTERROUND(a, b, c, d)                                             \
+  do {                                                                       \
+    a += b; d ^= a; d = ROTL32(d, 16);                                       \
+    c += d; b ^= c; b = ROTL32(b, 12);                                       \
+    a += b; d ^= a; d = ROTL32(d, 8);                                        \
+    c += d; b ^= c; b = ROTL32(b, 7);                                        \
+  } while (0)
+
+struct drbg {
+  unsigned char key[32];
+  unsigned char buffer[DRBG_BUFFER_SIZE];
+  /* unused bytes at the end of buffer */
+  size_t available;
+  uint64_t untilreseed;
+  unsigned int forks;
+  bool seeded;
+};
+
+static __thread struct drbg drbg;
+static pthread_once_t atforkonce = PTHREAD_ONCE_INIT;
+static volatile unsigned int forks;
+
+static uint32_t load32(const unsigned char *x)
+{
+  return (uint32_t)x[0] | (uint32_t)x[1] << 8 | (uint32_t)x[2] << 16 |
+      (uint32_t)x[3] << 24;
+}
+
+static void store32(unsigned char *x, uint32_t u)
+{
+  x[0] = (unsigned char)u;
+  x[1] = (unsigned char)(u >> 8);
+  x[2] = (unsigned char)(u >> 16);
+  x[3] = (unsigned char)(u >> 24);
+}
+
+STATIC void chacha20_block(unsigned char *out, const unsigned char *key,
+    uint32_t counter, const unsigned char *nonce)
+{
+  uint32_t state[16], x[16];
+  int i;
+
+  /* "expand 32-byte k" */
+  state[0] = 0x61707865;
+  state[1] = 0x3320646e;
+  state[2] = 0x79622d32;
+  state[3] = 0x6b206574;
+
+  for (i = 0; i < 8; i++)
+    state[4 + i] = load32(key + 4 * i);
+
+  state[12] = counter;
+  state[13] = load32(nonce);
+  state[14] = load32(nonce + 4);
+  state[15] = load32(nonce + 8);
+
+  memcpy(x, state, sizeof x);
+
+  for (i = 0; i < 10; i++) {
+    QUARTERROUND(x[0], x[4], x[8], x[12]);
+    QUARTERROUND(x[1], x[5], x[9], x[13]);
+    QUARTERROUND(x[2], x[6], x[10], x[14]);
+    QUARTERROUND(x[3], x[7], x[11], x[15]);
+    QUARTERROUND(x[0], x[5], x[10], x[15]);
+    QUARTERROUND(x[1], x[6], x[11], x[12]);
+    QUARTERROUND(x[2], x[7], x[8], x[13]);
+    QUARTERROUND(x[3], x[4], x[9], x[14]);
+  }
+
+  for (i = 0; i < 16; i++)
+    store32(out + 4 * i, x[i] + state[i]);
+
+  sbmemzero(state, sizeof state);
+  sbmemzero(x, sizeof x);
+}
+
+static void drbg_atfork_child(void)
+{
+  forks++;
+}
+
+static void drbg_atfork_init(void)
+{
+  pthread_atfork(NULL, NULL, drbg_atfork_child);
+}
+
+STATIC void drbg_reseed(struct drbg *d)
+{
+  unsigned char seed[32];
+
+  devurandom_read(seed, sizeof seed);
+
+  /* keep what is left of the old key, a bad seed can't make it worse */
+  for (size_t i = 0; i < sizeof seed; i++)
+    d->key[i] ^= seed[i];
+
+  sbmemzero(seed, sizeof seed);
+  sbmemzero(d->buffer, sizeof d->buffer);
+
+  d->available = 0;
+  d->untilreseed = DRBG_RESEED_BYTES;
+  d->forks = forks;
+  d->seeded = true;
+}
+
+STATIC void drbg_refill(struct drbg *d)
+{
+  static const unsigned char nonce[12] = { 0 };
+
+  if (!d->seeded || d->forks != forks || d->untilreseed < sizeof d->buffer) {
+    pthread_once(&atforkonce, drbg_atfork_init);
+    drbg_reseed(d);
+  }
+
+  for (uint32_t i = 0; i < DRBG_BUFFER_SIZE / DRBG_BLOCK_SIZE; i++)
+    chacha20_block(d->buffer + i * DRBG_BLOCK_SIZE, d->key, i, nonce);
+
+  /* the first 32 bytes of keystream replace the key */
+  memcpy(d->key, d->buffer, sizeof d->key);
+  sbmemzero(d->buffer, sizeof d->key);
+
+  d->available = sizeof d->buffer - sizeof d->key;
+  d->untilreseed -= sizeof d->buffer;
+}
+
+void randombytes(unsigned char *x, unsigned long long xlen)
+{
+  unsigned char *p;
+  size_t n;
+
+  while (xlen > 0) {
+    if (drbg.available == 0 || drbg.forks != forks)
+      drbg_refill(&drbg);
+
+    n = xlen < drbg.available ? (size_t)xlen : drbg.available;
+    p = drbg.buffer + sizeof drbg.buffer - drbg.available;
+
+    memcpy(x, p, n);
+    sbmemzero(p, n);
+
+    drbg.available -= n;
+    x += n;
+    xlen -= n;
+  }
+}
@@ -0,0 +1,28 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "sb-common.h"
+
+#define DRBG_BLOCK_SIZE 64
+
+struct drbg;
+
+STATIC void chacha20_block(unsigned char *out, const unsigned char *key,
+    uint32_t counter, const unsigned char *nonce);
+STATIC void drbg_reseed(struct drbg *d);
+STATIC void drbg_refill(struct drbg *d);
@@ -138,7 +138,8 @@
   }
 
 /* callid -> pluginkey
- * connection id -> connection */
+ * connection id -> connection
+ * msgid -> pending callinfo */
 MAP_IMPL(uint64_t, ptr_t, DEFAULT_INITIALIZER)
 
 /* pluginkey -> connection
@@ -24,7 +24,66 @@
 #include "rpc/db/sb-db.h"
 
 int8_t verbose_level;
-uv_loop_t loop;
+
+/* runs on every shard, shard 0 is the main thread */
+static int setup(void)
+{
+  options *globaloptions;
+  struct timeval timeout = { 1, 500000 };
+
+  globaloptions = options_get();
+
+  /* connect to database */
+  if (db_connect(fmt_addr(&globaloptions->RedisDatabaseListenAddr),
+      globaloptions->RedisDatabaseListenPort, timeout,
+      globaloptions->RedisDatabaseAuth) < 0) {
+    LOG_ERROR("Failed to connect to database");
+    return (-1);
+  }
+
+  /* initialize event queue */
+  if (event_initialize((unsigned int)globaloptions->EventBudget) == -1) {
+    LOG_ERROR("Failed to initialize event queue.");
+    return (-1);
+  }
+
+  /* connection_init() already initialized the main thread */
+  if (shard_self() != 0 && connection_thread_init() == -1) {
+    LOG_ERROR("Failed to initialise connections.");
+    return (-1);
+  }
+
+  if (crypto_minutekey_start() == -1) {
+    LOG_ERROR("Failed to start the minute key rotation.");
+    return (-1);
+  }
+
+  if (connection_prewarm((size_t)globaloptions->ConnectionPrewarm) == -1) {
+    LOG_ERROR("Failed to preallocate connections.");
+    return (-1);
+  }
+
+  if (server_init() == -1) {
+    LOG_ERROR("Failed to initialise server.");
+    return (-1);
+  }
+
+  /* initialize server, a pipe is served by shard 0 only */
+  if (globaloptions->apitype == SERVER_TYPE_TCP) {
+    if (server_start_tcp(&globaloptions->ApiTransportListenAddr,
+        globaloptions->ApiTransportListenPort) == -1) {
+      LOG_ERROR("Failed to start tcp server.");
+      return (-1);
+    }
+  } else if (globaloptions->apitype == SERVER_TYPE_PIPE && shard_self() == 0) {
+    if (server_start_pipe(globaloptions->ApiNamedPipeListen) == -1) {
+      LOG_ERROR("Failed to start pipe server.");
+      return (-1);
+    }
+  }
+
+  return (0);
+}
 
 int main(int argc, char **argv)
 {
@@ -40,51 +99,34 @@ int main(int argc, char **argv)
 
   uv_loop_init(&loop);
 
-  crypto_init();
-
-  struct timeval timeout = { 1, 500000 };
-
-  globaloptions = options_get();
+  secretbox_init();
+  curve25519_init();
 
-  /* connect to database */
-  if (db_connect(fmt_addr(&globaloptions->RedisDatabaseListenAddr),
-      globaloptions->RedisDatabaseListenPort, timeout,
-      globaloptions->RedisDatabaseAuth) < 0) {
-    LOG_ERROR("Failed to connect to database");
+  if (crypto_init() == -1) {
+    LOG_ERROR("Failed to initialize crypto.");
     abort();
   }
 
+  globaloptions = options_get();
+
   /* initialize signal handler */
   if (signal_init() == -1) {
     LOG_ERROR("Failed to initialize signal handler.");
     abort();
   }
 
-  /* initialize event queue */
-  if (event_initialize() == -1) {
-    LOG_ERROR("Failed to initialize event queue.");
-    abort();
-  }
-
   /* initialize connections */
   if (connection_init() == -1) {
     LOG_ERROR("Failed to initialise connections.");
     abort();
   }
 
-  if (server_init() == -1) {
-    LOG_ERROR("Failed to initialise server.");
+  if (shard_init((unsigned int)globaloptions->WorkerThreads) == -1 ||
+      shard_start(setup) == -1) {
+    LOG_ERROR("Failed to start worker threads.");
     abort();
   }
 
-  /* initialize server */
-  if (globaloptions->apitype == SERVER_TYPE_TCP) {
-    server_start_tcp(&globaloptions->ApiTransportListenAddr,
-        globaloptions->ApiTransportListenPort);
-  } else if (globaloptions->apitype == SERVER_TYPE_PIPE) {
-    server_start_pipe(globaloptions->ApiNamedPipeListen);
-  }
-
   uv_run(&loop, UV_RUN_DEFAULT);
 
   options_free(globaloptions);
@@ -48,9 +48,11 @@
  *    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE
  */
 
+#include <strings.h>
 #include <unistd.h>
 #include "sb-common.h"
 #include "options.h"
+#include "rpc/sb-rpc.h"
 
 #define BOXRC ".boxrc"
 
@@ -90,6 +92,19 @@ static configvar option_vars_[] = {
   V(RedisDatabaseListen,        STRING, NULL),
   V(RedisDatabaseAuth,          STRING, NULL),
   V(ContactInfo,                STRING,   NULL),
+  V(ConnectionInputBufferMax,   MEMUNIT,  "1 MB"),
+  V(ConnectionPacketMax,        MEMUNIT,  "16 MB"),
+  V(ConnectionOutputHighWatermark, MEMUNIT, "1 MB"),
+  V(ConnectionOutputLowWatermark, MEMUNIT, "256 KB"),
+  V(WorkerThreads,              UINT,     "1"),
+  V(CryptoOffloadThreshold,     MEMUNIT,  "64 KB"),
+  V(EphemeralKeyPool,           UINT,     "64"),
+  V(KeyCacheSize,               UINT,     "1024"),
+  V(KeyCacheTTL,                INTERVAL, "1 hour"),
+  V(ConnectionPrewarm,          UINT,     "0"),
+  V(EventBudget,                UINT,     "64"),
+  V(PluginWeight,               LINELIST, NULL),
+  V(ZeroCopyThreshold,          MEMUNIT,  "0"),
   { NULL, CONFIG_TYPE_OBSOLETE, 0, NULL }
 };
 
@@ -267,6 +282,86 @@ STATIC int options_validate(options *options)
     // do we need additional checks here for this string
   }
 
+  /* a connection must at least be able to buffer the handshake packets */
+  if (options->ConnectionInputBufferMax < 1024) {
+    LOG_WARNING("ConnectionInputBufferMax must be at least 1 KB.");
+    return (-1);
+  }
+
+  if (options->ConnectionPacketMax < 1024) {
+    LOG_WARNING("ConnectionPacketMax must be at least 1 KB.");
+    return (-1);
+  }
+
+  if (options->ConnectionOutputLowWatermark >=
+      options->ConnectionOutputHighWatermark) {
+    LOG_WARNING("ConnectionOutputLowWatermark must be less than "
+        "ConnectionOutputHighWatermark.");
+    return (-1);
+  }
+
+  if (options->WorkerThreads < 1 || options->WorkerThreads > SHARD_MAX) {
+    LOG_WARNING("WorkerThreads must be between 1 and %d.", SHARD_MAX);
+    return (-1);
+  }
+
+  if (options->EventBudget < 1) {
+    LOG_WARNING("EventBudget must be at least 1.");
+    return (-1);
+  }
+
+  for (configline *cl = options->PluginWeight; cl; cl = cl->next) {
+    if (parse_plugin_weight(cl->value, NULL) < 0) {
+      LOG_WARNING("PluginWeight must be a plugin key and a weight between 1 "
+          "and %d, not \"%s\".", PLUGIN_WEIGHT_MAX, cl->value);
+      return (-1);
+    }
+  }
+
+  return (0);
+}
+
+unsigned int options_plugin_weight(const char *pluginkey)
+{
+  unsigned int weight;
+
+  for (configline *cl = options_get()->PluginWeight; cl; cl = cl->next) {
+    if (parse_plugin_weight(cl->value, &weight) == 0 &&
+        strncasecmp(cl->value, pluginkey, PLUGINKEY_SIZE * 2) == 0)
+      return (weight);
+  }
+
+  return (1);
+}
+
+/** Parse a PluginWeight line, a plugin key in hex and the weight of the
+ * plugin. Return 0 and store the weight in <b>weight</b> unless it is NULL,
+ * return -1 if the line is malformed. */
+STATIC int parse_plugin_weight(const char *value, unsigned int *weight)
+{
+  long w;
+  int ok;
+  int i;
+
+  for (i = 0; i < PLUGINKEY_SIZE * 2; i++) {
+    if (!ISXDIGIT(value[i]))
+      return (-1);
+  }
+
+  if (!ISSPACE(value[i]))
+    return (-1);
+
+  while (ISSPACE(value[i]))
+    i++;
+
+  w = parse_long(value + i, 10, 1, PLUGIN_WEIGHT_MAX, &ok, NULL);
+
+  if (!ok)
+    return (-1);
+
+  if (weight)
+    *weight = (unsigned int)w;
+
   return (0);
 }
 
@@ -22,3 +22,4 @@ STATIC setoptionerror options_init_from_string(const char *cf);
 STATIC int options_validate(options *options);
 STATIC void options_init(options *options);
 STATIC char * load_boxrc_from_disk(void);
+STATIC int parse_plugin_weight(const char *value, unsigned int *weight);
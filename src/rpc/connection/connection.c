@@ -43,43 +43,127 @@
 
 #include "tweetnacl.h"
 #include "rpc/sb-rpc.h"
+#include "rpc/msgpack/sb-msgpack-rpc.h"
 #include "rpc/connection/connection.h"
 #include "api/sb-api.h"
 
 STATIC int parse_cb(inputstream *istream, void *data, bool eof);
+STATIC int parse_frames(struct connection *con, inputstream *istream);
+STATIC void unbox_cb(int status, uint64_t plaintextlen, void *data);
 STATIC void close_cb(uv_handle_t *handle);
-STATIC void timer_cb(uv_timer_t *timer);
 STATIC int connection_handle_request(struct connection *con,
-    msgpack_object *obj);
+    msgpack_unpacked *result, string raw);
 STATIC void connection_handle_response(struct connection *con,
     msgpack_object *obj);
 STATIC void connection_request_event(connection_request_event_info *info);
 STATIC void connection_close(struct connection *con);
 STATIC void call_set_error(struct connection *con, char *msg);
 STATIC int is_valid_rpc_response(msgpack_object *obj, struct connection *con);
+STATIC struct callinfo *get_pending_call(struct connection *con,
+    uint64_t msgid);
 STATIC void free_connection(struct connection *con);
 STATIC void incref(struct connection *con);
 STATIC void decref(struct connection *con);
-
-static uint64_t next_con_id = 1;
-static hashmap(uint64_t, ptr_t) *connections = NULL;
+STATIC msgpack_sbuffer *sbuf_acquire(struct connection *con);
+STATIC void sbuf_release(msgpack_sbuffer *sbuf);
+STATIC msgpack_unpacker *unpacker_acquire(void);
+STATIC void unpacker_release(msgpack_unpacker *mpac);
+STATIC void apply_backpressure(struct connection *con);
+STATIC void slab_teardown(slab *sl);
+STATIC int write_message(struct connection *con, struct message_request *req,
+    struct message_response *res);
+STATIC void release_backpressure(struct connection *con);
+STATIC void drain_cb(outputstream *ostream, void *data);
+STATIC void resume_parsing(struct connection *con);
+STATIC void pluginkey_register(struct connection *con);
+STATIC void pluginkey_unregister(struct connection *con);
+STATIC uint64_t pluginkey_lookup(char *pluginkey);
+STATIC int send_request(struct connection *con, string method, array params,
+    callinfo_cb cb, void *data);
+STATIC void remote_request_task(void *data);
+STATIC void remote_response_task(void *data);
+STATIC int post_response(uint64_t con_id, uint32_t msgid, array params,
+    struct api_error *api_error, bool iserror);
+
+/* state needed to send a request or response on another shard */
+struct remote_request {
+  uint64_t con_id;
+  string method;
+  array params;
+  callinfo_cb cb;
+  void *data;
+};
+
+struct remote_response {
+  uint64_t con_id;
+  uint32_t msgid;
+  bool iserror;
+  array params;
+  struct api_error api_error;
+};
+
+/* connections are owned by the shard (thread) that accepted them */
+static __thread uint64_t next_con_id = 1;
+static __thread hashmap(uint64_t, ptr_t) *connections = NULL;
+static __thread kvec_t(msgpack_sbuffer *) sbufpool;
+static __thread kvec_t(msgpack_unpacker *) unpackerpool;
+/* sizes of the request arenas, they size the arenas of new requests */
+static __thread struct arena_histogram requestsizes;
+static __thread slab connectionslab = SLAB_INIT("connection",
+    struct connection);
+/* the connection whose input is currently processed */
+static __thread struct connection *inputsource = NULL;
+/* shared by all shards, guarded by pluginkeyslock */
 static hashmap(cstr_t, uint64_t) *pluginkeys = NULL;
-static msgpack_sbuffer sbuf;
-equeue *equeue_root;
-uv_loop_t loop;
+static uv_mutex_t pluginkeyslock;
 
 int connection_init(void)
 {
-  connections = hashmap_new(uint64_t, ptr_t)();
   pluginkeys = hashmap_new(cstr_t, uint64_t)();
 
   if (dispatch_table_init() == -1)
     return (-1);
 
-  if (!connections || !pluginkeys)
+  if (!pluginkeys || uv_mutex_init(&pluginkeyslock) != 0)
+    return (-1);
+
+  return (connection_thread_init());
+}
+
+int connection_thread_init(void)
+{
+  connections = hashmap_new(uint64_t, ptr_t)();
+
+  if (!connections)
     return (-1);
 
-  msgpack_sbuffer_init(&sbuf);
+  kv_init(sbufpool);
+  kv_init(unpackerpool);
+
+  return (0);
+}
+
+int connection_prewarm(size_t count)
+{
+  msgpack_unpacker *mpac;
+
+  if (slab_prewarm(&connectionslab, count) != 0 ||
+      slab_prewarm(&streamslab, count) != 0 ||
+      slab_prewarm(&streamhandleslab, count) != 0 ||
+      slab_prewarm(&inputstreamslab, count) != 0 ||
+      slab_prewarm(&outputstreamslab, count) != 0 ||
+      slab_prewarm(&writerequestslab, count) != 0 ||
+      slab_prewarm(&equeueslab, count) != 0)
+    return (-1);
+
+  while (kv_size(unpackerpool) < MIN(count, UNPACKER_POOL_SIZE)) {
+    mpac = msgpack_unpacker_new(MSGPACK_UNPACKER_INIT_BUFFER_SIZE);
+
+    if (!mpac)
+      return (-1);
+
+    kv_push(msgpack_unpacker *, unpackerpool, mpac);
+  }
 
   return (0);
 }
@@ -97,32 +181,66 @@ int connection_teardown(void)
 
   hashmap_free(uint64_t, ptr_t)(connections);
   hashmap_free(cstr_t, uint64_t)(pluginkeys);
+  uv_mutex_destroy(&pluginkeyslock);
 
   dispatch_teardown();
-  msgpack_sbuffer_destroy(&sbuf);
+
+  while (kv_size(sbufpool))
+    msgpack_sbuffer_free(kv_pop(sbufpool));
+
+  kv_destroy(sbufpool);
+
+  while (kv_size(unpackerpool))
+    msgpack_unpacker_free(kv_pop(unpackerpool));
+
+  kv_destroy(unpackerpool);
+
+  slab_teardown(&connectionslab);
+  slab_teardown(&streamslab);
+  slab_teardown(&streamhandleslab);
+  slab_teardown(&inputstreamslab);
+  slab_teardown(&outputstreamslab);
+  slab_teardown(&writerequestslab);
+  slab_teardown(&equeueslab);
 
   return (0);
 }
 
-int connection_create(uv_stream_t *stream)
+/*
+ * Logs the stats of `sl` and frees its chunks. Objects still in use, e.g.
+ * stream handles waiting for their close callback, keep the slab alive.
+ */
+STATIC void slab_teardown(slab *sl)
 {
-  int r;
+  slab_log_stats(sl);
+
+  if (sl->stats.inuse == 0)
+    slab_destroy(sl);
+}
 
+int connection_create(uv_stream_t *stream)
+{
   stream->data = NULL;
 
-  struct connection *con = MALLOC(struct connection);
+  struct connection *con = SLAB_MALLOC(&connectionslab, struct connection);
 
   if (con == NULL)
     return (-1);
 
-  con->id = next_con_id++;
+  con->id = next_con_id++ * SHARD_MAX + shard_self();
   con->msgid = 1;
+  con->pausecount = 0;
   con->refcount = 1;
-  con->mpac = msgpack_unpacker_new(MSGPACK_UNPACKER_INIT_BUFFER_SIZE);
+  con->mpac = unpacker_acquire();
+  con->sbuf = NULL;
   con->closed = false;
+  con->stalled = false;
   con->queue = equeue_new(equeue_root);
-  con->streams.read = inputstream_new(parse_cb, STREAM_BUFFER_SIZE, con);
-  con->streams.write = outputstream_new(1024 * 1024);
+  con->streams.read = inputstream_new(parse_cb,
+      options_get()->ConnectionInputBufferMax, con);
+  con->streams.write = outputstream_new(
+      options_get()->ConnectionOutputHighWatermark,
+      options_get()->ConnectionOutputLowWatermark);
   con->streams.uv = stream;
   con->cc.nonce = (uint64_t) randommod(281474976710656LL);
 
@@ -132,26 +250,19 @@ int connection_create(uv_stream_t *stream)
 
   con->cc.receivednonce = 0;
   con->cc.state = TUNNEL_INITIAL;
+  con->cc.queue = NULL;
 
-  /* crypto minutekey timer */
-  randombytes(con->cc.minutekey, sizeof con->cc.minutekey);
-  randombytes(con->cc.lastminutekey, sizeof con->cc.lastminutekey);
-  con->minutekey_timer.data = &con->cc;
-  r = uv_timer_init(&loop, &con->minutekey_timer);
-  sbassert(r == 0);
-  r = uv_timer_start(&con->minutekey_timer, timer_cb, 60000, 60000);
-  sbassert(r == 0);
-
-  con->packet.data = NULL;
-  con->packet.start = 0;
-  con->packet.end = 0;
+  con->packet.state = FRAME_HEADER;
+  con->packet.length = 0;
   con->packet.pos = 0;
 
-  kv_init(con->callvector);
+  con->calls = NULL;
+  kv_init(con->paused);
 
   inputstream_set(con->streams.read, stream);
   inputstream_start(con->streams.read);
   outputstream_set(con->streams.write, stream);
+  outputstream_set_drain_cb(con->streams.write, drain_cb, con);
 
   hashmap_put(uint64_t, ptr_t)(connections, con->id, con);
 
@@ -170,6 +281,111 @@ STATIC void decref(struct connection *con)
   }
 }
 
+/*
+ * Returns the serialization buffer of the connection. Buffers are taken
+ * from a pool and keep their capacity, so repeated sends don't need to grow
+ * them again.
+ */
+STATIC msgpack_sbuffer *sbuf_acquire(struct connection *con)
+{
+  if (con->sbuf)
+    return (con->sbuf);
+
+  if (kv_size(sbufpool))
+    con->sbuf = kv_pop(sbufpool);
+  else
+    con->sbuf = msgpack_sbuffer_new();
+
+  return (con->sbuf);
+}
+
+STATIC void sbuf_release(msgpack_sbuffer *sbuf)
+{
+  if (kv_size(sbufpool) >= SBUF_POOL_SIZE || sbuf->alloc > SBUF_POOL_MAX_ALLOC) {
+    msgpack_sbuffer_free(sbuf);
+    return;
+  }
+
+  msgpack_sbuffer_clear(sbuf);
+  kv_push(msgpack_sbuffer *, sbufpool, sbuf);
+}
+
+/*
+ * Returns an unpacker for a new connection. Unpackers are taken from a pool
+ * and keep their buffer, the buffer of a new one is allocated right away.
+ */
+STATIC msgpack_unpacker *unpacker_acquire(void)
+{
+  if (kv_size(unpackerpool))
+    return (kv_pop(unpackerpool));
+
+  return (msgpack_unpacker_new(MSGPACK_UNPACKER_INIT_BUFFER_SIZE));
+}
+
+STATIC void unpacker_release(msgpack_unpacker *mpac)
+{
+  /* only unpackers without leftover input of the closed connection */
+  if (kv_size(unpackerpool) >= UNPACKER_POOL_SIZE || mpac->used != mpac->off ||
+      mpac->used + mpac->free > UNPACKER_POOL_MAX_BUFFER) {
+    msgpack_unpacker_free(mpac);
+    return;
+  }
+
+  msgpack_unpacker_reset(mpac);
+  kv_push(msgpack_unpacker *, unpackerpool, mpac);
+}
+
+/*
+ * Called after writing to `con`. If the output of `con` is congested, the
+ * connection whose input caused the write stops reading until `con`
+ * drained, e.g. a plugin flooding a slow plugin with run requests.
+ */
+STATIC void apply_backpressure(struct connection *con)
+{
+  struct connection *source = inputsource;
+
+  if (!source || source == con || source->closed || con->closed ||
+      !con->streams.write || !outputstream_congested(con->streams.write))
+    return;
+
+  for (size_t i = 0; i < kv_size(con->paused); i++) {
+    if (kv_A(con->paused, i) == source->id)
+      return;
+  }
+
+  kv_push(uint64_t, con->paused, source->id);
+
+  if (!source->pausecount++) {
+    LOG_VERBOSE(VERBOSE_LEVEL_1, "pausing connection %lu\n",
+        source->id);
+    inputstream_pause(source->streams.read);
+  }
+}
+
+/* resumes the connections paused because of the output of `con` */
+STATIC void release_backpressure(struct connection *con)
+{
+  struct connection *source;
+
+  for (size_t i = 0; i < kv_size(con->paused); i++) {
+    source = hashmap_get(uint64_t, ptr_t)(connections, kv_A(con->paused, i));
+
+    if (!source || source->closed || --source->pausecount)
+      continue;
+
+    LOG_VERBOSE(VERBOSE_LEVEL_1, "resuming connection %lu\n",
+        source->id);
+    inputstream_resume(source->streams.read);
+  }
+
+  kv_size(con->paused) = 0;
+}
+
+STATIC void drain_cb(UNUSED(outputstream *ostream), void *data)
+{
+  release_backpressure(data);
+}
+
 
 int connection_hashmap_put(uint64_t id, struct connection *con)
 {
@@ -178,44 +394,94 @@ int connection_hashmap_put(uint64_t id, struct connection *con)
 
 int pluginkeys_hashmap_put(char *pluginkey, uint64_t id)
 {
+  uv_mutex_lock(&pluginkeyslock);
   hashmap_put(cstr_t, uint64_t)(pluginkeys, pluginkey, id);
+  uv_mutex_unlock(&pluginkeyslock);
 }
 
-STATIC void free_connection(struct connection *con)
+/*
+ * Maps the pluginkey of `con` to `con`. The key is stored by reference, so
+ * a mapping of an older connection with the same key is replaced entirely.
+ */
+STATIC void pluginkey_register(struct connection *con)
 {
-  hashmap_del(uint64_t, ptr_t)(connections, con->id);
+  uv_mutex_lock(&pluginkeyslock);
   hashmap_del(cstr_t, uint64_t)(pluginkeys, con->cc.pluginkeystring);
-  msgpack_unpacker_free(con->mpac);
-  kv_destroy(con->callvector);
-  equeue_free(con->queue);
+  hashmap_put(cstr_t, uint64_t)(pluginkeys, con->cc.pluginkeystring, con->id);
+  uv_mutex_unlock(&pluginkeyslock);
+}
 
-  if (con->packet.data)
-    FREE(con->packet.data);
+STATIC void pluginkey_unregister(struct connection *con)
+{
+  if (con->cc.state != TUNNEL_ESTABLISHED)
+    return;
 
-  FREE(con);
+  uv_mutex_lock(&pluginkeyslock);
+  if (hashmap_get(cstr_t, uint64_t)(pluginkeys, con->cc.pluginkeystring) ==
+      con->id)
+    hashmap_del(cstr_t, uint64_t)(pluginkeys, con->cc.pluginkeystring);
+  uv_mutex_unlock(&pluginkeyslock);
 }
 
-STATIC void timer_cb(uv_timer_t *timer)
+STATIC uint64_t pluginkey_lookup(char *pluginkey)
 {
-  struct crypto_context *cc = (struct crypto_context*)timer->data;
-  crypto_update_minutekey(cc);
+  uint64_t id;
+
+  uv_mutex_lock(&pluginkeyslock);
+  id = hashmap_get(cstr_t, uint64_t)(pluginkeys, pluginkey);
+  uv_mutex_unlock(&pluginkeyslock);
+
+  return (id);
+}
+
+STATIC void free_connection(struct connection *con)
+{
+  hashmap_del(uint64_t, ptr_t)(connections, con->id);
+  pluginkey_unregister(con);
+  unpacker_release(con->mpac);
+  if (con->sbuf)
+    sbuf_release(con->sbuf);
+  if (con->calls)
+    hashmap_free(uint64_t, ptr_t)(con->calls);
+  kv_destroy(con->paused);
+
+  equeue_free(con->queue);
+
+  SLAB_FREE(&connectionslab, con);
 }
 
 STATIC void connection_close(struct connection *con)
 {
-  int is_closing;
   uv_handle_t *handle;
-  uv_handle_t *timer_handle;
+  struct callinfo *cinfo;
+  kvec_t(struct callinfo *) failed;
 
   if (con->closed)
     return;
 
-  timer_handle = (uv_handle_t*) &con->minutekey_timer;
-  if (timer_handle) {
-    uv_close(timer_handle, NULL);
-    uv_run(&loop, UV_RUN_ONCE);
+  con->closed = true;
+
+  /* fail all calls still waiting for a response of this connection */
+  if (con->calls) {
+    kv_init(failed);
+
+    hashmap_foreach_value(con->calls, cinfo, {
+      kv_push(struct callinfo *, failed, cinfo);
+    });
+
+    for (size_t i = 0; i < kv_size(failed); i++) {
+      cinfo = kv_A(failed, i);
+      cinfo->errorresponse = true;
+      loop_complete_call(con, cinfo);
+    }
+
+    kv_destroy(failed);
   }
 
+  /* nobody waits for this connection to drain anymore */
+  release_backpressure(con);
+  crypto_close(&con->cc);
+
   inputstream_free(con->streams.read);
   outputstream_free(con->streams.write);
   handle = (uv_handle_t *)con->streams.uv;
@@ -223,162 +489,227 @@ STATIC void connection_close(struct connection *con)
   if (handle)
     uv_close(handle, close_cb);
 
-  kv_destroy(con->callvector);
-
-  con->closed = 0;
-
   decref(con);
 }
 
 
 STATIC void close_cb(uv_handle_t *handle)
 {
-  FREE(handle->data);
-  FREE(handle);
+  streamhandle_free(handle);
 }
 
-STATIC void reset_packet(struct connection *con)
+/*
+ * Parses all complete message packets pending in the inputstream. Packets
+ * that are contiguous in the ring buffer are unboxed in place and their
+ * plaintext is copied to the unpacker buffer. The body of a packet that
+ * wraps around the ring or is larger than the pending data is collected in
+ * the unpacker buffer and unboxed there. Large packets are unboxed on the
+ * threadpool, parsing continues in unbox_cb() then.
+ */
+STATIC int parse_frames(struct connection *con, inputstream *istream)
 {
-  con->packet.start = 0;
-  con->packet.end = 0;
-  con->packet.pos = 0;
+  struct inputstream_view view;
+  unsigned char header[CRYPTO_HEADER_SIZE];
+  unsigned char *packet;
+  unsigned char *box;
+  uint64_t plaintextlen;
+  uint64_t bodylen;
+  size_t pending;
+  size_t count;
+
+  for (;;) {
+    if (con->packet.state == FRAME_UNBOXING)
+      return (0);
+
+    pending = inputstream_get_view(istream, &view);
+
+    if (con->packet.state == FRAME_HEADER) {
+      if (pending < CRYPTO_HEADER_SIZE)
+        return (0);
+
+      if (view.len[0] >= CRYPTO_HEADER_SIZE) {
+        packet = view.data[0];
+      } else {
+        /* the header wraps around the end of the ring buffer */
+        memcpy(header, view.data[0], view.len[0]);
+        memcpy(header + view.len[0], view.data[1],
+            CRYPTO_HEADER_SIZE - view.len[0]);
+        packet = header;
+      }
+
+      if (crypto_verify_header(&con->cc, packet, &con->packet.length) != 0)
+        return (-1);
+
+      if (con->packet.length < CRYPTO_HEADER_SIZE + crypto_box_BOXZEROBYTES)
+        return (-1);
+
+      /* the body is buffered apart from the inputstream, bound it here */
+      if (con->packet.length > options_get()->ConnectionPacketMax)
+        return (-1);
+
+      if (view.len[0] >= con->packet.length &&
+          !crypto_offload(con->packet.length)) {
+        if (!msgpack_unpacker_reserve_buffer(con->mpac,
+            con->packet.length - CRYPTO_HEADER_SIZE - crypto_box_BOXZEROBYTES))
+          return (-1);
+
+        if (crypto_read(&con->cc, view.data[0],
+            msgpack_unpacker_buffer(con->mpac), con->packet.length,
+            &plaintextlen) != 0)
+          return (-1);
+
+        msgpack_unpacker_buffer_consumed(con->mpac, plaintextlen);
+        inputstream_consume(istream, con->packet.length);
+        continue;
+      }
+
+      /* the body is collected behind crypto_box_BOXZEROBYTES zero bytes */
+      if (!msgpack_unpacker_reserve_buffer(con->mpac,
+          con->packet.length - CRYPTO_HEADER_SIZE + crypto_box_BOXZEROBYTES))
+        return (-1);
+
+      memset(msgpack_unpacker_buffer(con->mpac), 0, crypto_box_BOXZEROBYTES);
+      inputstream_consume(istream, CRYPTO_HEADER_SIZE);
+      con->packet.state = FRAME_BODY;
+      con->packet.pos = 0;
+      continue;
+    }
+
+    if (!pending)
+      return (0);
+
+    box = (unsigned char *)msgpack_unpacker_buffer(con->mpac);
+    bodylen = con->packet.length - CRYPTO_HEADER_SIZE;
+    count = (size_t)MIN(pending, bodylen - con->packet.pos);
+
+    inputstream_read(istream, box + crypto_box_BOXZEROBYTES + con->packet.pos,
+        count);
+    con->packet.pos += count;
+
+    if (con->packet.pos < bodylen)
+      return (0);
+
+    if (crypto_offload(con->packet.length)) {
+      con->packet.state = FRAME_UNBOXING;
+      incref(con);
+
+      if (crypto_unbox_async(&con->cc, box, con->packet.length, unbox_cb,
+          con) != 0) {
+        decref(con);
+        return (-1);
+      }
+
+      return (0);
+    }
+
+    con->packet.state = FRAME_HEADER;
+
+    if (crypto_unbox(&con->cc, box, con->packet.length, &plaintextlen) != 0)
+      return (-1);
+
+    memmove(box, box + crypto_box_ZEROBYTES, plaintextlen);
+    msgpack_unpacker_buffer_consumed(con->mpac, plaintextlen);
+  }
 }
 
-STATIC void reset_parser(struct connection *con)
+STATIC void unbox_cb(int status, uint64_t plaintextlen, void *data)
 {
-  FREE(con->packet.data);
-  reset_packet(con);
+  struct connection *con = data;
+  unsigned char *box;
+
+  if (con->closed)
+    goto end;
+
+  con->packet.state = FRAME_HEADER;
+
+  if (status != 0) {
+    LOG_WARNING("invalid message packet, closing connection");
+    connection_close(con);
+    goto end;
+  }
+
+  box = (unsigned char *)msgpack_unpacker_buffer(con->mpac);
+  memmove(box, box + crypto_box_ZEROBYTES, plaintextlen);
+  msgpack_unpacker_buffer_consumed(con->mpac, plaintextlen);
+
+  /* deserialize the packet and everything received meanwhile */
+  parse_cb(con->streams.read, con, false);
+
+end:
+  decref(con);
 }
 
 STATIC int parse_cb(inputstream *istream, void *data, bool eof)
 {
-  unsigned char *packet;
   unsigned char hellopacket[192];
   unsigned char initiatepacket[256];
   struct connection *con = data;
+  msgpack_unpacked result;
+  size_t rawstart;
+  bool whole;
+  string raw;
 
   incref(con);
 
-  size_t read = 0;
-  size_t pending;
-  size_t size;
-  uint64_t plaintextlen;
-  uint64_t consumedlen = 0;
-  uint64_t dummylen = 0;
-  msgpack_unpacked result;
-
   if (eof) {
     connection_close(con);
     goto fail;
   }
 
   if (con->cc.state == TUNNEL_INITIAL) {
-    size = inputstream_read(istream, hellopacket, 192);
+    inputstream_read(istream, hellopacket, 192);
     if (crypto_recv_hello_send_cookie(&con->cc, hellopacket,
         con->streams.write) != 0)
       LOG_WARNING("establishing crypto tunnel failed at hello-cookie packet");
 
     goto fail;
   } else if (con->cc.state == TUNNEL_COOKIE_SENT) {
-    size = inputstream_read(istream, initiatepacket, 256);
+    inputstream_read(istream, initiatepacket, 256);
     if (crypto_recv_initiate(&con->cc, initiatepacket) != 0) {
       LOG_WARNING("establishing crypto tunnel failed at initiate packet");
       con->cc.state = TUNNEL_INITIAL;
+    } else {
+      pluginkey_register(con);
+      equeue_set_weight(con->queue,
+          options_plugin_weight(con->cc.pluginkeystring));
     }
-
-    hashmap_put(cstr_t, uint64_t)(pluginkeys, con->cc.pluginkeystring,
-      con->id);
   }
 
-  pending = inputstream_pending(istream);
-
-  if (pending <= 0 || con->cc.state != TUNNEL_ESTABLISHED)
+  if (con->cc.state != TUNNEL_ESTABLISHED)
     goto fail;
 
-  if (con->packet.end <= 0) {
-    packet = inputstream_get_read(istream, &read);
-
-    /* read the packet length */
-    if (crypto_verify_header(&con->cc, packet, &con->packet.length)) {
-      reset_packet(con);
-      goto fail;
-    }
-
-    con->packet.end = con->packet.length;
-    con->packet.data = MALLOC_ARRAY(MAX(con->packet.end, read), unsigned char);
-
-    if (!con->packet.data) {
-      LOG_ERROR("Failed to alloc mem for con packet.");
-      goto fail;
-    }
-
-    if (msgpack_unpacker_reserve_buffer(con->mpac,
-      MAX(read, con->packet.end)) == false) {
-      LOG_ERROR("Failed to reserve mem msgpack buffer.");
-      goto fail;
-    };
-
-    /* get decrypted message start position */
-    con->unpackbuf = msgpack_unpacker_buffer(con->mpac);
+  /* a broken packet can't be skipped, the stream is out of sync then */
+  if (parse_frames(con, istream) != 0) {
+    LOG_WARNING("invalid message packet, closing connection");
+    connection_close(con);
+    goto fail;
   }
 
-  while(read > 0) {
-    con->packet.start = inputstream_read(istream,
-      con->packet.data + con->packet.pos, con->packet.end);
-    con->packet.pos += con->packet.start;
-    con->packet.end -= con->packet.start;
-    read -= con->packet.start;
-
-    if (read > 0 && con->packet.end == 0) {
-      if (crypto_read(&con->cc, con->packet.data, con->unpackbuf +
-          consumedlen, con->packet.length, &plaintextlen) != 0) {
-        reset_parser(con);
-        goto fail;
-      }
-
-      consumedlen += plaintextlen;
-      packet = inputstream_get_read(istream, &dummylen);
-
-      if (packet == NULL) {
-        reset_parser(con);
-        goto fail;
-      }
-
-      if (crypto_verify_header(&con->cc, packet, &con->packet.length)) {
-        reset_parser(con);
-        goto fail;
-      }
-
-      con->packet.end = con->packet.length;
+  /* the unpacker buffer is in use by the threadpool, see unbox_cb() */
+  if (con->packet.state == FRAME_UNBOXING) {
+    decref(con);
+    return (0);
+  }
 
-      continue;
-    }
+  msgpack_unpacked_init(&result);
 
-    if (con->packet.end > 0 && read == 0) {
-      decref(con);
-      return (0);
-    }
+  /* deserialize objects, one by one, as long as requests can be queued */
+  while (!equeue_full(con->queue)) {
+    /* a message parsed in one go lies in the buffer as a whole */
+    rawstart = con->mpac->off;
+    whole = msgpack_unpacker_parsed_size(con->mpac) == 0;
 
-    if (crypto_read(&con->cc, con->packet.data, con->unpackbuf +
-        consumedlen, con->packet.length, &plaintextlen) != 0) {
-      reset_parser(con);
-      goto fail;
-    }
+    if (msgpack_unpacker_next(con->mpac, &result) != MSGPACK_UNPACK_SUCCESS)
+      break;
 
-    consumedlen += plaintextlen;
-    reset_packet(con);
-    FREE(con->packet.data);
-  }
+    raw = (string) STRING_INIT;
 
-  msgpack_unpacker_buffer_consumed(con->mpac, consumedlen);
-  msgpack_unpacked_init(&result);
-  msgpack_unpack_return ret;
+    if (whole)
+      raw = (string) {.str = con->mpac->buffer + rawstart,
+          .length = con->mpac->off - rawstart};
 
-  /* deserialize objects, one by one */
-  while ((ret =
-      msgpack_unpacker_next(con->mpac, &result)) == MSGPACK_UNPACK_SUCCESS) {
     if (message_is_request(&result.data))
-      connection_handle_request(con, &result.data);
+      connection_handle_request(con, &result, raw);
     else if (message_is_response(&result.data)) {
       if (is_valid_rpc_response(&result.data, con)) {
         connection_handle_response(con, &result.data);
@@ -393,6 +724,18 @@ STATIC int parse_cb(inputstream *istream, void *data, bool eof)
     }
   }
 
+  msgpack_unpacked_destroy(&result);
+
+  /* the rest waits until the scheduler ran events of this connection */
+  if (equeue_full(con->queue) && !con->stalled && !con->closed) {
+    con->stalled = true;
+
+    if (!con->pausecount++) {
+      LOG_VERBOSE(VERBOSE_LEVEL_1, "pausing connection %lu\n", con->id);
+      inputstream_pause(con->streams.read);
+    }
+  }
+
   decref(con);
 
   return (0);
@@ -402,20 +745,52 @@ fail:
   return (-1);
 }
 
-struct callinfo connection_send_request(char *pluginkey, string method,
-    array params, struct api_error *api_error)
+int connection_send_request(char *pluginkey, string method, array params,
+    callinfo_cb cb, void *data, struct api_error *api_error)
 {
   uint64_t id;
   struct connection *con;
-  msgpack_packer packer;
-  struct message_request request;
+  struct remote_request *remote;
 
-  id = hashmap_get(cstr_t, uint64_t)(pluginkeys, pluginkey);
+  id = pluginkey_lookup(pluginkey);
 
   if (id == 0) {
     free_params(params);
     error_set(api_error, API_ERROR_TYPE_VALIDATION, "plugin not registered");
-    return CALLINFO_INIT;
+    return (-1);
+  }
+
+  if (shard_count() > 1 && SHARD_OF(id) != shard_self()) {
+    /* the other shard sends after the caller returned, views of its request
+       are copied now */
+    for (size_t i = 0; i < params.size; i++) {
+      if (message_object_own(&params.obj[i], NULL) == -1) {
+        free_params(params);
+        return (-1);
+      }
+    }
+
+    remote = MALLOC(struct remote_request);
+
+    if (!remote) {
+      free_params(params);
+      return (-1);
+    }
+
+    remote->con_id = id;
+    remote->method = cstring_copy_string(method.str);
+    remote->params = params;
+    remote->cb = cb;
+    remote->data = data;
+
+    if (shard_post(SHARD_OF(id), remote_request_task, remote) != 0) {
+      free_string(remote->method);
+      free_params(params);
+      FREE(remote);
+      return (-1);
+    }
+
+    return (0);
   }
 
   con = hashmap_get(uint64_t, ptr_t)(connections, id);
@@ -427,44 +802,142 @@ struct callinfo connection_send_request(char *pluginkey, string method,
   if (!con) {
     free_params(params);
     error_set(api_error, API_ERROR_TYPE_VALIDATION, "plugin not registered");
-    return CALLINFO_INIT;
+    return (-1);
+  }
+
+  return (send_request(con, method, params, cb, data));
+}
+
+/* sends a request to the local connection `con`, `params` are freed */
+STATIC int send_request(struct connection *con, string method, array params,
+    callinfo_cb cb, void *data)
+{
+  struct callinfo *cinfo;
+  struct message_request request;
+  int ret;
+
+  cinfo = MALLOC(struct callinfo);
+
+  if (!cinfo) {
+    free_params(params);
+    return (-1);
   }
 
-  incref(con);
   request.msgid = con->msgid++;
   request.method = method;
   request.params = params;
 
-  msgpack_packer_init(&packer, &sbuf, msgpack_sbuffer_write);
-  message_serialize_request(&request, &packer);
+  ret = write_message(con, &request, NULL);
   free_params(params);
 
   LOG_VERBOSE(VERBOSE_LEVEL_0, "sending request: method = %s,  callinfo id = %u\n",
-      method, request.msgid);
-  if (crypto_write(&con->cc, sbuf.data, sbuf.size, con->streams.write) != 0)
-    return CALLINFO_INIT;
+      method.str, request.msgid);
 
-  struct callinfo cinfo = (struct callinfo) {request.msgid, false, false,((struct message_response) {0, ARRAY_INIT})};
+  if (ret != 0) {
+    FREE(cinfo);
+    return (-1);
+  }
 
-  loop_wait_for_response(con, &cinfo);
+  apply_backpressure(con);
 
-  msgpack_sbuffer_clear(&sbuf);
+  cinfo->msgid = request.msgid;
+  cinfo->errorresponse = false;
+  cinfo->response = (struct message_response) {0, ARRAY_INIT};
+  cinfo->cb = cb;
+  cinfo->data = data;
 
-  decref(con);
+  /* the response is handled by the event loop, don't wait for it here */
+  loop_register_call(con, cinfo);
 
-  if (cinfo.errorresponse)
-    return CALLINFO_INIT;
+  return (0);
+}
+
+STATIC void remote_request_task(void *data)
+{
+  struct remote_request *remote = data;
+  struct connection *con;
+  struct callinfo cinfo;
+
+  con = hashmap_get(uint64_t, ptr_t)(connections, remote->con_id);
+
+  if (!con || con->closed) {
+    free_params(remote->params);
+    goto fail;
+  }
+
+  if (send_request(con, remote->method, remote->params, remote->cb,
+      remote->data) != 0)
+    goto fail;
 
-  return cinfo;
+  free_string(remote->method);
+  FREE(remote);
+  return;
+
+fail:
+  /* the sender already returned, it learns about the failure in `cb` */
+  cinfo.msgid = 0;
+  cinfo.errorresponse = true;
+  cinfo.response = (struct message_response) {0, ARRAY_INIT};
+  cinfo.cb = remote->cb;
+  cinfo.data = remote->data;
+
+  if (cinfo.cb)
+    cinfo.cb(&cinfo, cinfo.data);
+
+  free_string(remote->method);
+  FREE(remote);
+}
+
+STATIC void remote_response_task(void *data)
+{
+  struct remote_response *remote = data;
+
+  if (remote->iserror) {
+    connection_send_error_response(remote->con_id, remote->msgid,
+        &remote->api_error);
+  } else if (connection_send_response(remote->con_id, remote->msgid,
+      remote->params, &remote->api_error) != 0) {
+    free_params(remote->params);
+  }
+
+  FREE(remote);
+}
+
+/*
+ * Hands a response for the connection `con_id` of another shard over to
+ * that shard. `params` are owned by the shard from now on.
+ */
+STATIC int post_response(uint64_t con_id, uint32_t msgid, array params,
+    struct api_error *api_error, bool iserror)
+{
+  struct remote_response *remote = MALLOC(struct remote_response);
+
+  if (!remote)
+    return (-1);
+
+  remote->con_id = con_id;
+  remote->msgid = msgid;
+  remote->iserror = iserror;
+  remote->params = params;
+  remote->api_error = *api_error;
+
+  if (shard_post(SHARD_OF(con_id), remote_response_task, remote) != 0) {
+    FREE(remote);
+    return (-1);
+  }
+
+  return (0);
 }
 
 int connection_send_response(uint64_t con_id, uint32_t msgid,
     array params, struct api_error *api_error)
 {
-  msgpack_packer packer;
   struct message_response response;
   struct connection *con;
 
+  if (shard_count() > 1 && SHARD_OF(con_id) != shard_self())
+    return (post_response(con_id, msgid, params, api_error, false));
+
   con = hashmap_get(uint64_t, ptr_t)(connections, con_id);
 
   /*
@@ -476,42 +949,142 @@ int connection_send_response(uint64_t con_id, uint32_t msgid,
     return (-1);
   }
 
+  if (api_error->isset)
+    return (-1);
+
   response.msgid = msgid;
   response.params = params;
 
-  msgpack_packer_init(&packer, &sbuf, msgpack_sbuffer_write);
-  message_serialize_response(&response, &packer);
+  if (write_message(con, NULL, &response) != 0)
+    return (-1);
+
+  free_params(params);
+  apply_backpressure(con);
+
+  return 0;
+}
 
-  if (api_error->isset) {
+
+int connection_send_error_response(uint64_t con_id, uint32_t msgid,
+    struct api_error *api_error)
+{
+  msgpack_sbuffer *sbuf;
+  msgpack_packer packer;
+  struct connection *con;
+
+  if (shard_count() > 1 && SHARD_OF(con_id) != shard_self())
+    return (post_response(con_id, msgid, (array) ARRAY_INIT, api_error, true));
+
+  con = hashmap_get(uint64_t, ptr_t)(connections, con_id);
+
+  if (!con)
+    return (-1);
+
+  sbuf = sbuf_acquire(con);
+
+  if (!sbuf)
     return (-1);
-  }
 
-  if (crypto_write(&con->cc, sbuf.data, sbuf.size, con->streams.write) != 0) {
+  msgpack_packer_init(&packer, sbuf, msgpack_sbuffer_write);
+
+  if (message_serialize_error_response(&packer, api_error, msgid) != 0 ||
+      crypto_write(&con->cc, sbuf->data, sbuf->size, con->streams.write) != 0) {
+    msgpack_sbuffer_clear(sbuf);
     return (-1);
   }
 
-  msgpack_sbuffer_clear(&sbuf);
-  free_params(params);
+  msgpack_sbuffer_clear(sbuf);
+  apply_backpressure(con);
 
-  return 0;
+  return (0);
+}
+
+
+/*
+ * Encodes `req` or, if it is NULL, `res` right into a packet of the exact
+ * size precomputed for it and sends that, so neither an msgpack_sbuffer nor
+ * a copy of the encoded message is needed.
+ */
+STATIC int write_message(struct connection *con, struct message_request *req,
+    struct message_response *res)
+{
+  struct pack_buffer buffer;
+  msgpack_packer packer;
+  unsigned char *packet;
+  int ret;
+
+  buffer.size = req ? message_serialize_request_size(req) :
+      message_serialize_response_size(res);
+  buffer.used = 0;
+  packet = MALLOC_ARRAY(CRYPTO_PACKET_OFFSET + buffer.size, unsigned char);
+
+  if (!packet)
+    return (-1);
+
+  buffer.data = (char *)packet + CRYPTO_PACKET_OFFSET;
+  msgpack_packer_init(&packer, &buffer, pack_buffer_write);
+
+  ret = req ? message_serialize_request(req, &packer) :
+      message_serialize_response(res, &packer);
+
+  if (ret != 0 || buffer.used != buffer.size) {
+    LOG_WARNING("Failed to serialize message of %zu bytes", buffer.size);
+    FREE(packet);
+    return (-1);
+  }
+
+  return (crypto_write_packet(&con->cc, packet, buffer.size,
+      con->streams.write));
 }
 
 
 STATIC int connection_handle_request(struct connection *con,
-    msgpack_object *obj)
+    msgpack_unpacked *result, string raw)
 {
   dispatch_info dispatcher;
   struct api_error api_error = ERROR_INIT;
   connection_request_event_info eventinfo;
+  struct unpack_options opts;
   api_event event;
+  string method;
 
-  if (!obj || !con)
+  if (!result || !con)
     return (-1);
 
-  if (message_deserialize_request(&eventinfo.request, obj, &api_error) != 0) {
+  eventinfo.zone = NULL;
+
+  /* without an arena the request is allocated object by object */
+  opts.arena = arena_new(&requestsizes);
+  opts.viewthreshold = options_get()->ZeroCopyThreshold;
+  opts.raw = raw;
+  opts.rawparam = 0;
+
+  /* arguments that are only forwarded aren't decoded */
+  method = message_get_method(&result->data);
+
+  if (raw.str && method.str)
+    opts.rawparam = dispatch_table_get(method).rawparam;
+
+  if (message_deserialize_request_view(&eventinfo.request, &result->data,
+      &api_error, &opts) != 0) {
     /* request wasn't parsed correctly, send error with pseudo RESPONSE ID*/
+    arena_free(opts.arena);
     eventinfo.request.msgid = MESSAGE_RESPONSE_UNKNOWN;
     eventinfo.request.method = cstring_copy_string("error");
+    eventinfo.request.params = (array) ARRAY_INIT;
+    eventinfo.request.arena = NULL;
+  } else if (params_have_views(eventinfo.request.params)) {
+    /* the views are valid until the request was handled */
+    eventinfo.zone = unpack_zone_new(msgpack_unpacked_release_zone(result));
+
+    if (!eventinfo.zone) {
+      message_request_free(&eventinfo.request);
+      error_set(&api_error, API_ERROR_TYPE_VALIDATION,
+          "Error unpacking params");
+      eventinfo.request.msgid = MESSAGE_RESPONSE_UNKNOWN;
+      eventinfo.request.method = cstring_copy_string("error");
+      eventinfo.request.params = (array) ARRAY_INIT;
+    }
   }
 
   LOG_VERBOSE(VERBOSE_LEVEL_0, "received request: method = %s\n",
@@ -523,7 +1096,7 @@ STATIC int connection_handle_request(struct connection *con,
     LOG_VERBOSE(VERBOSE_LEVEL_0, "could not dispatch method\n");
     error_set(&api_error, API_ERROR_TYPE_VALIDATION, "could not dispatch method");
     dispatcher.func = handle_error;
-    dispatcher.async = true;
+    dispatcher.async = false;
   }
 
   eventinfo.con = con;
@@ -537,9 +1110,12 @@ STATIC int connection_handle_request(struct connection *con,
   else {
     event.handler = connection_request_event;
     event.info = eventinfo;
-    equeue_put(con->queue, event);
-    /* TODO: move this call to a suitable place (main?) */
-    equeue_run_events(equeue_root);
+
+    /* parse_cb() stops before the queue is full, don't drop it anyway */
+    if (equeue_put(con->queue, event) != 0)
+      connection_request_event(&eventinfo);
+    else if (equeue_schedule(equeue_root) != 0)
+      equeue_run_events(equeue_root);
   }
 
   return (0);
@@ -548,37 +1124,61 @@ STATIC int connection_handle_request(struct connection *con,
 
 STATIC void connection_request_event(connection_request_event_info *eventinfo)
 {
-  msgpack_packer packer;
   struct connection *con;
 
+  struct connection *previous = inputsource;
+
   con = eventinfo->con;
+  inputsource = con;
 
   eventinfo->dispatcher.func(con->id, &eventinfo->request,
       con->cc.pluginkeystring, &eventinfo->api_error);
 
-  if (eventinfo->api_error.isset) {
-    msgpack_packer_init(&packer, &sbuf, msgpack_sbuffer_write);
-    message_serialize_error_response(&packer, &eventinfo->api_error,
-        eventinfo->request.msgid);
+  if (eventinfo->api_error.isset)
+    connection_send_error_response(con->id, eventinfo->request.msgid,
+        &eventinfo->api_error);
 
-    crypto_write(&eventinfo->con->cc, sbuf.data, sbuf.size,
-        eventinfo->con->streams.write);
+  inputsource = previous;
 
-    msgpack_sbuffer_clear(&sbuf);
-  }
+  message_request_free(&eventinfo->request);
+  unpack_zone_unref(eventinfo->zone);
 
-  free_params(eventinfo->request.params);
-  free_string(eventinfo->request.method);
+  /* the event left room in the queue of the connection */
+  if (con->stalled && !con->closed)
+    resume_parsing(con);
 
   decref(con);
 }
 
-STATIC int is_valid_rpc_response(msgpack_object *obj, struct connection *con)
+/*
+ * Continues with the messages a connection sent while its request queue was
+ * full and reads from it again.
+ */
+STATIC void resume_parsing(struct connection *con)
+{
+  con->stalled = false;
+
+  if (!--con->pausecount) {
+    LOG_VERBOSE(VERBOSE_LEVEL_1, "resuming connection %lu\n", con->id);
+    inputstream_resume(con->streams.read);
+  }
+
+  parse_cb(con->streams.read, con, false);
+}
+
+STATIC struct callinfo *get_pending_call(struct connection *con,
+    uint64_t msgid)
 {
-  uint64_t msg_id = message_get_id(obj);
+  if (!con->calls)
+    return (NULL);
+
+  return (hashmap_get(uint64_t, ptr_t)(con->calls, msgid));
+}
+
 
-  return kv_size(con->callvector) && msg_id
-      == kv_A(con->callvector, kv_size(con->callvector) - 1)->msgid;
+STATIC int is_valid_rpc_response(msgpack_object *obj, struct connection *con)
+{
+  return (get_pending_call(con, message_get_id(obj)) != NULL);
 }
 
 
@@ -586,14 +1186,14 @@ STATIC void connection_handle_response(struct connection *con,
     msgpack_object *obj)
 {
   struct callinfo *cinfo;
-  struct api_error api_error = { .isset = false };
+  struct connection *previous;
+  struct api_error api_error = ERROR_INIT;
 
-  cinfo = kv_A(con->callvector, kv_size(con->callvector) - 1);
+  cinfo = get_pending_call(con, message_get_id(obj));
 
   LOG_VERBOSE(VERBOSE_LEVEL_0, "received response: callinfo id = %u\n",
       cinfo->msgid);
 
-  cinfo->hasresponse = true;
   cinfo->errorresponse = message_is_error_response(obj);
 
   if (cinfo->errorresponse) {
@@ -601,17 +1201,19 @@ STATIC void connection_handle_response(struct connection *con,
   } else {
     message_deserialize_response(&cinfo->response, obj, &api_error);
   }
+
+  if (api_error.isset)
+    cinfo->errorresponse = true;
+
+  /* the callback typically forwards the response to another connection */
+  previous = inputsource;
+  inputsource = con;
+  loop_complete_call(con, cinfo);
+  inputsource = previous;
 }
 
 STATIC void call_set_error(struct connection *con, UNUSED(char *msg))
 {
-  struct callinfo *cinfo;
-
-  for (size_t i = 0; i < kv_size(con->callvector); i++) {
-      cinfo = kv_A(con->callvector, i);
-      cinfo->errorresponse = true;
-      cinfo->hasresponse = true;
-  }
-
+  /* pending calls are failed when closing the connection */
   connection_close(con);
 }
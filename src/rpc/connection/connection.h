@@ -20,11 +20,14 @@
 
 STATIC void close_cb(uv_handle_t *handle);
 STATIC int connection_handle_request(struct connection *con,
-    msgpack_object *obj);
+    msgpack_unpacked *result, string raw);
 STATIC void connection_handle_response(struct connection *con,
     msgpack_object *obj);
 STATIC void connection_request_event(connection_request_event_info *info);
 STATIC void connection_close(struct connection *con);
 STATIC int parse_cb(inputstream *istream, void *data, bool eof);
+STATIC int parse_frames(struct connection *con, inputstream *istream);
 STATIC int is_valid_rpc_response(msgpack_object *obj, struct connection *con);
+STATIC struct callinfo *get_pending_call(struct connection *con,
+    uint64_t msgid);
 STATIC void call_set_error(struct connection *con, char *msg);
@@ -21,84 +21,113 @@
 
 static unsigned char serverlongtermsk[32];
 
-static uint64_t counterlow;
-static uint64_t counterhigh;
-static unsigned char flagkeyloaded;
 static unsigned char noncekey[32];
+/* packets of at least this size are (un)boxed on the threadpool */
+static uint64_t offloadthreshold = UINT64_MAX;
+/* cookie keys of the shard, replaced every minute */
+static __thread struct {
+  unsigned char current[32];
+  unsigned char last[32];
+  uv_timer_t timer;
+  bool seeded;
+} minutekeys;
+
+/* a packet waiting to be boxed and written */
+struct crypto_job {
+  uv_work_t req;
+  struct crypto_queue *queue;
+  unsigned char *packet;
+  unsigned long long packetlen;
+  unsigned char header[CRYPTO_HEADER_SIZE];
+  unsigned char nonce[crypto_box_NONCEBYTES];
+  unsigned char key[32];
+  int status;
+  bool done;
+  TAILQ_ENTRY(crypto_job) node;
+};
+
+struct crypto_queue {
+  TAILQ_HEAD(, crypto_job) jobs;
+  outputstream *out;
+  bool closed;
+};
+
+struct crypto_unbox_job {
+  uv_work_t req;
+  unsigned char *box;
+  uint64_t length;
+  unsigned char nonce[crypto_box_NONCEBYTES];
+  unsigned char key[32];
+  int status;
+  crypto_unbox_cb cb;
+  void *data;
+};
 
 STATIC int crypto_block(unsigned char *out, const unsigned char *in,
     const unsigned char *k);
-STATIC int safenonce(unsigned char *y, int flaglongterm);
+STATIC int noncekey_load(void);
+STATIC int safenonce(unsigned char *y);
 STATIC void nonce_update(struct crypto_context *cc);
+STATIC void minutekey_seed(void);
+STATIC void minutekey_cb(uv_timer_t *timer);
 
-int crypto_init(void)
+STATIC int noncekey_load(void)
 {
-  if (filesystem_load(".keys/server-long-term", serverlongtermsk,
-      sizeof serverlongtermsk) == -1)
-    return -1;
-
-  return 0;
-}
+  int fdlock;
 
+  fdlock = filesystem_open_lock(".keys/lock");
 
-STATIC int safenonce(unsigned char *y, int flaglongterm)
-{
-  unsigned char data[16];
-
-  sbassert(y);
-
-  if (!flagkeyloaded) {
-    int fdlock;
+  if (fdlock == -1)
+    return -1;
 
-    fdlock = filesystem_open_lock(".keys/lock");
+  if (filesystem_load(".keys/noncekey", noncekey, sizeof noncekey) == -1) {
+    close(fdlock);
+    return -1;
+  }
 
-    if (fdlock == -1)
-      return -1;
+  if (close(fdlock) == -1)
+    return -1;
 
-    if (filesystem_load(".keys/noncekey", noncekey, sizeof noncekey) == -1) {
-      close(fdlock);
-      return -1;
-    }
+  return 0;
+}
 
-    if (close(fdlock) == -1)
-      return -1;
+int crypto_init(void)
+{
+  if (filesystem_load(".keys/server-long-term", serverlongtermsk,
+      sizeof serverlongtermsk) == -1)
+    return -1;
 
-    flagkeyloaded = 1;
-  }
+  if (noncekey_load() == -1)
+    return -1;
 
-  if (counterlow >= counterhigh) {
-    int fdlock;
+  if (nonce_init() == -1)
+    return -1;
 
-    fdlock = filesystem_open_lock(".keys/lock");
+  offloadthreshold = options_get()->CryptoOffloadThreshold;
 
-    if (fdlock == -1)
-      return -1;
+  if (keypool_init((size_t)options_get()->EphemeralKeyPool) == -1)
+    return -1;
 
-    if (filesystem_load(".keys/noncecounter", data, 8) == -1) {
-      close(fdlock);
-      return -1;
-    }
+  if (keycache_init((size_t)options_get()->KeyCacheSize,
+      (uint64_t)options_get()->KeyCacheTTL * 1000) == -1)
+    return -1;
 
-    counterlow = uint64_unpack(data);
+  return 0;
+}
 
-    if (flaglongterm)
-      counterhigh = counterlow + 1048576;
-    else
-      counterhigh = counterlow + 1;
 
-    uint64_pack(data, counterhigh);
+STATIC int safenonce(unsigned char *y)
+{
+  unsigned char data[16];
+  uint64_t counter;
 
-    if (filesystem_save_sync(".keys/noncecounter", data, 8) == -1) {
-      close(fdlock);
-      return -1;
-    }
+  sbassert(y);
 
-    if (close(fdlock) == -1)
-      return -1;
-  }
+  if (nonce_reserve(&counter) == -1)
+    return -1;
 
+  uint64_pack(data, counter);
   randombytes(data + 8, 8);
-  uint64_pack(data, counterlow++);
   crypto_block(y, data, noncekey);
 
   return 0;
@@ -218,12 +247,43 @@ uint64_t uint64_unpack(const unsigned char *x)
 }
 
 
-void crypto_update_minutekey(struct crypto_context *cc)
+STATIC void minutekey_seed(void)
 {
-  sbassert(cc);
+  if (minutekeys.seeded)
+    return;
+
+  randombytes(minutekeys.current, sizeof minutekeys.current);
+  randombytes(minutekeys.last, sizeof minutekeys.last);
+  minutekeys.seeded = true;
+}
+
+STATIC void minutekey_cb(UNUSED(uv_timer_t *timer))
+{
+  crypto_update_minutekey();
+}
+
+int crypto_minutekey_start(void)
+{
+  minutekey_seed();
+
+  if (uv_timer_init(&loop, &minutekeys.timer) != 0)
+    return -1;
+
+  if (uv_timer_start(&minutekeys.timer, minutekey_cb, 60000, 60000) != 0)
+    return -1;
+
+  /* the rotation alone doesn't keep the loop running */
+  uv_unref((uv_handle_t *)&minutekeys.timer);
+
+  return 0;
+}
+
+void crypto_update_minutekey(void)
+{
+  minutekey_seed();
 
-  memcpy(cc->lastminutekey, cc->minutekey, sizeof cc->lastminutekey);
-  randombytes(cc->minutekey, sizeof cc->minutekey);
+  memcpy(minutekeys.last, minutekeys.current, sizeof minutekeys.last);
+  randombytes(minutekeys.current, sizeof minutekeys.current);
 }
 
 
@@ -276,6 +336,7 @@ int crypto_recv_hello_send_cookie(struct crypto_context *cc,
   unsigned char allzeroboxed[96] = { 0 };
   unsigned char cookiebox[160] = { 0 };
   unsigned char cookiepacket[168];
+  unsigned char *frame;
   uint64_t packetnonce;
 
   sbassert(cc);
@@ -311,8 +372,8 @@ int crypto_recv_hello_send_cookie(struct crypto_context *cc,
 
   /* send cookie packet */
 
-  /* generate server ephemeral keys */
-  if (crypto_box_keypair(cc->servershorttermpk, cc->servershorttermsk) != 0)
+  /* take server ephemeral keys from the pool */
+  if (keypool_pop(cc->servershorttermpk, cc->servershorttermsk) != 0)
     goto fail;
 
   memcpy(cookiebox + 96, cc->clientshorttermpk, 32);
@@ -320,13 +381,15 @@ int crypto_recv_hello_send_cookie(struct crypto_context *cc,
 
   memcpy(nonce, CRYPTO_MINUTE_KEY, 8);
 
-  if (safenonce(nonce + 8, 1) == -1) {
+  if (safenonce(nonce + 8) == -1) {
     LOG_ERROR("nonce-generation disaster");
     goto fail;
   }
 
-  if (crypto_secretbox(cookiebox + 64, cookiebox + 64, 96, nonce, cc->minutekey)
-      != 0)
+  minutekey_seed();
+
+  if (crypto_secretbox(cookiebox + 64, cookiebox + 64, 96, nonce,
+      minutekeys.current) != 0)
     goto fail;
 
   memcpy(cookiebox + 64, nonce + 8, 16);
@@ -342,9 +405,19 @@ int crypto_recv_hello_send_cookie(struct crypto_context *cc,
   memcpy(cookiepacket + 8, nonce + 8, 16);
   memcpy(cookiepacket + 24, cookiebox + 16, 144);
 
-  if (outputstream_write(out, (char *)cookiepacket, 168) < 0)
+  /* the outputstream takes ownership of the frame */
+  frame = MALLOC_ARRAY(sizeof cookiepacket, unsigned char);
+
+  if (frame == NULL)
     goto fail;
 
+  memcpy(frame, cookiepacket, sizeof cookiepacket);
+
+  if (outputstream_write(out, (char *)frame, sizeof cookiepacket) < 0) {
+    FREE(frame);
+    goto fail;
+  }
+
   cc->state = TUNNEL_COOKIE_SENT;
 
   sbmemzero(clientshortserverlong, sizeof clientshortserverlong);
@@ -376,6 +449,7 @@ int crypto_recv_initiate(struct crypto_context *cc, unsigned char *data)
   unsigned char clientlongtermpk[32];
   unsigned char clientlongserverlong[32];
   uint64_t packetnonce;
+  bool cached;
 
   sbassert(cc);
   sbassert(data);
@@ -390,11 +464,13 @@ int crypto_recv_initiate(struct crypto_context *cc, unsigned char *data)
 
   memcpy(cookie + 16, data + 24, 80);
 
-  if (crypto_secretbox_open(cookie, cookie, 96, nonce, cc->minutekey)) {
+  minutekey_seed();
+
+  if (crypto_secretbox_open(cookie, cookie, 96, nonce, minutekeys.current)) {
     sbmemzero(cookie, 16);
     memcpy(cookie + 16, data + 24, 80);
 
-    if (crypto_secretbox_open(cookie, cookie, 96, nonce, cc->lastminutekey))
+    if (crypto_secretbox_open(cookie, cookie, 96, nonce, minutekeys.last))
       goto fail;
   }
 
@@ -433,7 +509,12 @@ int crypto_recv_initiate(struct crypto_context *cc, unsigned char *data)
     goto fail;
   }
 
-  crypto_box_beforenm(clientlongserverlong, clientlongtermpk, serverlongtermsk);
+  /* plugins reconnect with the same long-term key */
+  cached = (keycache_get(clientlongserverlong, clientlongtermpk) == 0);
+
+  if (!cached)
+    crypto_box_beforenm(clientlongserverlong, clientlongtermpk,
+        serverlongtermsk);
 
   memcpy(nonce, CRYPTO_PREFIX_VNONCE, 8);
   memcpy(nonce + 8, initiatebox + 64, 16);
@@ -450,6 +531,10 @@ int crypto_recv_initiate(struct crypto_context *cc, unsigned char *data)
   if (!byte_isequal(initiatebox + 128, 32, cc->servershorttermpk))
     goto fail;
 
+  /* only keys that opened a valid vouch get cached */
+  if (!cached)
+    keycache_put(clientlongtermpk, clientlongserverlong);
+
   cc->receivednonce = packetnonce;
 
   cc->state = TUNNEL_ESTABLISHED;
@@ -480,146 +565,361 @@ fail:
 int crypto_write(struct crypto_context *cc, char *data,
     size_t length, outputstream *out)
 {
-  unsigned long long packetlen;
   unsigned char *packet;
-  unsigned char *block = NULL;
-  unsigned char *ciphertext = NULL;
-  unsigned char lengthbox[40] = { 0 };
-  unsigned char nonce[crypto_box_NONCEBYTES];
-  uint64_t blocklen;
 
-  sbassert(cc);
   sbassert(data);
-  sbassert(out);
 
   /*
    * add 8 byte for identifier, 24 byte for boxed length and 8 byte for
    * compressed nonce. nacl api also requires 32 byte zero-padding
    * (crypto_box_ZEROBYTES)
    */
-  packetlen = length + 56;
-  packet = MALLOC_ARRAY(packetlen, unsigned char);
+  packet = MALLOC_ARRAY(length + CRYPTO_PACKET_OFFSET, unsigned char);
 
   if (packet == NULL)
     return -1;
 
-  /* update nonce */
-  nonce_update(cc);
+  memcpy(packet + CRYPTO_PACKET_OFFSET, data, length);
+
+  return crypto_write_packet(cc, packet, length, out);
+}
+
+
+int crypto_write_packet(struct crypto_context *cc, unsigned char *packet,
+    size_t length, outputstream *out)
+{
+  unsigned long long packetlen;
+  unsigned char *box;
+  unsigned char header[CRYPTO_HEADER_SIZE];
+  unsigned char lengthbox[40] = { 0 };
+  unsigned char lengthnonce[crypto_box_NONCEBYTES];
+  unsigned char nonce[crypto_box_NONCEBYTES];
+
+  sbassert(cc);
+  sbassert(packet);
+  sbassert(out);
 
-  memcpy(packet, CRYPTO_ID_MESSAGE_SERVER, 8);
+  packetlen = length + CRYPTO_PACKET_OFFSET;
+
+  /*
+   * the message is boxed in place. The zero-padding starts at packet + 24,
+   * so the ciphertext without its crypto_box_BOXZEROBYTES lands right
+   * behind the boxed length at packet + 40.
+   */
+  box = packet + 24;
 
   /* set nonce expansion prefix and compressed nonce (little-endian) */
+  nonce_update(cc);
+  memcpy(lengthnonce, CRYPTO_PREFIX_SPLONEBOXSERVER, 16);
+  uint64_pack(lengthnonce + 16, cc->nonce);
+
+  nonce_update(cc);
   memcpy(nonce, CRYPTO_PREFIX_SPLONEBOXSERVER, 16);
   uint64_pack(nonce + 16, cc->nonce);
 
+  memset(box, 0, crypto_box_ZEROBYTES);
+
+  /*
+   * the header overwrites the crypto_box_BOXZEROBYTES of the box, so it is
+   * built aside and copied in once the message is boxed
+   */
+  memcpy(header, CRYPTO_ID_MESSAGE_SERVER, 8);
+
   /* pack compressed nonce */
-  memcpy(packet + 8, nonce + 16, 8);
+  memcpy(header + 8, lengthnonce + 16, 8);
 
   uint64_pack(lengthbox + 32, packetlen);
 
-  if (crypto_box_afternm(lengthbox, lengthbox, 40, nonce,
+  if (crypto_box_afternm(lengthbox, lengthbox, 40, lengthnonce,
       cc->clientshortservershort) != 0)
     goto fail;
 
   /* pack boxed length */
-  memcpy(packet + 16, lengthbox + 16, 24);
+  memcpy(header + 16, lengthbox + 16, 24);
 
-  blocklen = length + 32;
-  block = CALLOC(blocklen, unsigned char);
-  ciphertext = MALLOC_ARRAY(blocklen, unsigned char);
+  /* packets behind a packet still being boxed have to wait for it */
+  if (crypto_offload(packetlen) || (cc->queue &&
+      !TAILQ_EMPTY(&cc->queue->jobs)))
+    return crypto_write_deferred(cc, packet, packetlen, header, nonce, out);
 
-  if ((block == NULL) || (ciphertext == NULL))
-    return -1;
-
-  memcpy(block + 32, data, length);
-
-  /* update nonce */
-  nonce_update(cc);
-  uint64_pack(nonce + 16, cc->nonce);
-
-  if (crypto_box_afternm(ciphertext, block, blocklen, nonce,
+  if (crypto_box_afternm(box, box, length + crypto_box_ZEROBYTES, nonce,
       cc->clientshortservershort) != 0)
     goto fail;
 
-  memcpy(packet + 40, ciphertext + 16, blocklen - 16);
+  memcpy(packet, header, CRYPTO_HEADER_SIZE);
 
   if (outputstream_write(out, (char *)packet, packetlen) < 0)
     goto fail;
 
-  sbmemzero(packet, sizeof packet);
-  sbmemzero(block, sizeof block);
-  sbmemzero(ciphertext, sizeof ciphertext);
-  FREE(ciphertext);
-  FREE(block);
+  /* packet is owned and freed by the outputstream from now on */
+  return 0;
+
+fail:
+  sbmemzero(packet, packetlen);
   FREE(packet);
 
+  return -1;
+}
+
+/*
+ * Queues `packet` behind the packets of `cc` that are still being boxed.
+ * Packets above the offload threshold are boxed on the threadpool, others
+ * right away. The queue is flushed in order as soon as its head is boxed.
+ */
+STATIC int crypto_write_deferred(struct crypto_context *cc,
+    unsigned char *packet, unsigned long long packetlen,
+    unsigned char *header, unsigned char *nonce, outputstream *out)
+{
+  struct crypto_job *job;
+
+  if (!cc->queue) {
+    cc->queue = MALLOC(struct crypto_queue);
+
+    if (!cc->queue)
+      goto fail;
+
+    TAILQ_INIT(&cc->queue->jobs);
+    cc->queue->closed = false;
+  }
+
+  cc->queue->out = out;
+
+  job = MALLOC(struct crypto_job);
+
+  if (!job)
+    goto fail;
+
+  job->req.data = job;
+  job->queue = cc->queue;
+  job->packet = packet;
+  job->packetlen = packetlen;
+  job->status = 0;
+  job->done = false;
+  memcpy(job->header, header, CRYPTO_HEADER_SIZE);
+  memcpy(job->nonce, nonce, crypto_box_NONCEBYTES);
+  memcpy(job->key, cc->clientshortservershort, sizeof job->key);
+
+  TAILQ_INSERT_TAIL(&cc->queue->jobs, job, node);
+
+  /* the packet counts as queued output while it is boxed, so that large
+     packets congest the connection right away */
+  outputstream_reserve(out, packetlen);
+
+  if (crypto_offload(packetlen) &&
+      uv_queue_work(&loop, &job->req, box_work_cb, box_done_cb) == 0)
+    return 0;
+
+  box_work_cb(&job->req);
+  box_done_cb(&job->req, 0);
+
   return 0;
 
 fail:
-  sbmemzero(packet, sizeof packet);
-  sbmemzero(block, sizeof block);
-  sbmemzero(ciphertext, sizeof ciphertext);
-  FREE(ciphertext);
-  FREE(block);
+  sbmemzero(packet, packetlen);
   FREE(packet);
 
   return -1;
 }
 
+STATIC void box_work_cb(uv_work_t *req)
+{
+  struct crypto_job *job = req->data;
+  unsigned char *box = job->packet + 24;
 
-int crypto_read(struct crypto_context *cc, unsigned char *in, char *out,
+  job->status = crypto_box_afternm(box, box, job->packetlen - 24, job->nonce,
+      job->key);
+}
+
+STATIC void box_done_cb(uv_work_t *req, int status)
+{
+  struct crypto_job *job = req->data;
+
+  if (status != 0)
+    job->status = -1;
+
+  job->done = true;
+  crypto_flush(job->queue);
+}
+
+/* writes the boxed packets at the head of `queue` */
+STATIC void crypto_flush(struct crypto_queue *queue)
+{
+  struct crypto_job *job;
+
+  while (!TAILQ_EMPTY(&queue->jobs)) {
+    job = TAILQ_FIRST(&queue->jobs);
+
+    if (!job->done)
+      break;
+
+    TAILQ_REMOVE(&queue->jobs, job, node);
+
+    if (!queue->closed && job->status == 0) {
+      memcpy(job->packet, job->header, CRYPTO_HEADER_SIZE);
+
+      if (outputstream_write(queue->out, (char *)job->packet,
+          job->packetlen) == 0)
+        job->packet = NULL;
+      else
+        LOG_WARNING("Failed to write message packet.");
+    } else if (job->status != 0) {
+      LOG_WARNING("Failed to box message packet.");
+    }
+
+    /* written packets are counted by the outputstream itself now, this may
+       drain it if the packet was dropped. A closed queue has no stream. */
+    if (!queue->closed)
+      outputstream_unreserve(queue->out, (size_t)job->packetlen);
+
+    if (job->packet) {
+      sbmemzero(job->packet, job->packetlen);
+      FREE(job->packet);
+    }
+
+    sbmemzero(job->key, sizeof job->key);
+    FREE(job);
+  }
+
+  if (queue->closed && TAILQ_EMPTY(&queue->jobs))
+    FREE(queue);
+}
+
+void crypto_close(struct crypto_context *cc)
+{
+  struct crypto_queue *queue = cc->queue;
+
+  if (!queue)
+    return;
+
+  cc->queue = NULL;
+  queue->closed = true;
+  queue->out = NULL;
+  crypto_flush(queue);
+}
+
+bool crypto_offload(uint64_t length)
+{
+  return (length >= offloadthreshold);
+}
+
+int crypto_unbox(struct crypto_context *cc, unsigned char *box,
     uint64_t length, uint64_t *plaintextlen)
 {
-  unsigned char *block;
-  unsigned char *ciphertextpadded;
   unsigned char nonce[crypto_box_NONCEBYTES];
-  uint64_t ciphertextlen;
-  uint64_t blocklen;
 
   sbassert(cc);
-  sbassert(in);
-  sbassert(out);
+  sbassert(box);
   sbassert(plaintextlen);
 
+  if (length < 56)
+    return -1;
+
   /* nonce is prefixed with 16-byte string "splonbox-client" */
 
   memcpy(nonce, CRYPTO_PREFIX_SPLONEBOXCLIENT, 16);
   uint64_pack(nonce + 16, cc->receivednonce + 2);
 
-  /* blocklen = length - 8 (id) - 24 (length) - 8 (nonce) */
-  blocklen = length - 40;
-  /* ciphertextlen = length - 8 (id) - 72 (length) - 8 (nonce) + 16 (padding) */
-  ciphertextlen = length - 24;
+  if (crypto_box_open_afternm(box, box, length - 24, nonce,
+      cc->clientshortservershort) != 0)
+    return -1;
+
+  *plaintextlen = length - 56;
+  cc->receivednonce += 2;
+
+  return 0;
+}
 
-  block = MALLOC_ARRAY(ciphertextlen, unsigned char);
-  ciphertextpadded = CALLOC(ciphertextlen, unsigned char);
 
-  if ((block == NULL) || (ciphertextpadded == NULL))
+int crypto_read(struct crypto_context *cc, unsigned char *in, char *out,
+    uint64_t length, uint64_t *plaintextlen)
+{
+  unsigned char *box;
+
+  sbassert(in);
+  sbassert(out);
+
+  if (length < 56)
     return -1;
 
-  memcpy(ciphertextpadded + 16, in + 40, blocklen);
+  /*
+   * the ciphertext starts at in + 40 (8 id, 24 length, 8 nonce). The 16
+   * bytes in front of it are part of the already verified header, reuse
+   * them as crypto_box_BOXZEROBYTES and unbox in place.
+   */
+  box = in + 24;
+  memset(box, 0, crypto_box_BOXZEROBYTES);
 
-  if (crypto_box_open_afternm(block, ciphertextpadded, ciphertextlen, nonce,
-      cc->clientshortservershort) != 0)
-    goto fail;
+  if (crypto_unbox(cc, box, length, plaintextlen) != 0) {
+    sbmemzero(in, length);
+    return -1;
+  }
 
-  *plaintextlen = length - 56;
-  memcpy(out, block + 32, *plaintextlen);
+  memcpy(out, box + crypto_box_ZEROBYTES, *plaintextlen);
+  sbmemzero(in, length);
 
-  cc->receivednonce += 2;
+  return 0;
+}
 
-  sbmemzero(block, sizeof block);
-  sbmemzero(ciphertextpadded, sizeof ciphertextpadded);
-  FREE(block);
-  FREE(ciphertextpadded);
+int crypto_unbox_async(struct crypto_context *cc, unsigned char *box,
+    uint64_t length, crypto_unbox_cb cb, void *data)
+{
+  struct crypto_unbox_job *job;
+
+  sbassert(cc);
+  sbassert(box);
+  sbassert(cb);
+
+  if (length < 56)
+    return -1;
+
+  job = MALLOC(struct crypto_unbox_job);
+
+  if (!job)
+    return -1;
+
+  job->req.data = job;
+  job->box = box;
+  job->length = length;
+  job->status = 0;
+  job->cb = cb;
+  job->data = data;
+  memcpy(job->key, cc->clientshortservershort, sizeof job->key);
+
+  /*
+   * the nonce is taken right away, the next packet header is only verified
+   * after the callback
+   */
+  memcpy(job->nonce, CRYPTO_PREFIX_SPLONEBOXCLIENT, 16);
+  uint64_pack(job->nonce + 16, cc->receivednonce + 2);
+
+  if (uv_queue_work(&loop, &job->req, unbox_work_cb, unbox_done_cb) != 0) {
+    sbmemzero(job->key, sizeof job->key);
+    FREE(job);
+    return -1;
+  }
+
+  cc->receivednonce += 2;
 
   return 0;
+}
 
-fail:
-  sbmemzero(block, sizeof block);
-  sbmemzero(ciphertextpadded, sizeof ciphertextpadded);
-  FREE(block);
-  FREE(ciphertextpadded);
+STATIC void unbox_work_cb(uv_work_t *req)
+{
+  struct crypto_unbox_job *job = req->data;
 
-  return -1;
+  job->status = crypto_box_open_afternm(job->box, job->box, job->length - 24,
+      job->nonce, job->key);
+}
+
+STATIC void unbox_done_cb(uv_work_t *req, int status)
+{
+  struct crypto_unbox_job *job = req->data;
+
+  if (status != 0)
+    job->status = -1;
+
+  job->cb(job->status, job->length - 56, job->data);
+
+  sbmemzero(job->key, sizeof job->key);
+  FREE(job);
 }
@@ -19,3 +19,11 @@
 #include "rpc/sb-rpc.h"
 
 STATIC void nonce_update(struct crypto_context *cc);
+STATIC int crypto_write_deferred(struct crypto_context *cc,
+    unsigned char *packet, unsigned long long packetlen,
+    unsigned char *header, unsigned char *nonce, outputstream *out);
+STATIC void box_work_cb(uv_work_t *req);
+STATIC void box_done_cb(uv_work_t *req, int status);
+STATIC void crypto_flush(struct crypto_queue *queue);
+STATIC void unbox_work_cb(uv_work_t *req);
+STATIC void unbox_done_cb(uv_work_t *req, int status);
@@ -31,14 +31,20 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
+#ifdef __linux__
+#include <bsd/string.h>
+#endif
 
 #include "rpc/sb-rpc.h"
 #include "api/sb-api.h"
 #include "sb-common.h"
 
-static msgpack_sbuffer sbuf;
 static hashmap(string, dispatch_info) *dispatch_table = NULL;
+/* shared by all shards, guarded by callidslock. The map owns copies of the
+   caller keys, the caller connection may be closed on another shard. */
 static hashmap(uint64_t, ptr_t) *callids = NULL;
+static uv_mutex_t callidslock;
 
 int handle_error(uint64_t con_id, struct message_request *request,
     char *pluginkey, struct api_error *error)
@@ -70,6 +76,14 @@ int handle_register(uint64_t con_id, struct message_request *request,
     return (-1);
   }
 
+  /* everything registered is used as C strings, views can't be */
+  if (message_object_own(&request->params.obj[0], request->arena) == -1 ||
+      message_object_own(&request->params.obj[1], request->arena) == -1) {
+    error_set(error, API_ERROR_TYPE_VALIDATION,
+        "Error dispatching register API request. Copying params failed");
+    return (-1);
+  }
+
   if (request->params.obj[0].type == OBJECT_TYPE_ARRAY)
     meta = &request->params.obj[0].data.params;
   else {
@@ -145,7 +159,7 @@ int handle_run(uint64_t con_id, struct message_request *request,
   uint64_t callid;
   array *meta = NULL;
   string function_name;
-  char *targetpluginkey;
+  char *targetpluginkey, *callerkey;
 
   struct message_object args_object;
 
@@ -159,6 +173,15 @@ int handle_run(uint64_t con_id, struct message_request *request,
     return (-1);
   }
 
+  /* the target key and function name are used as C strings, the arguments
+     are only passed on and may stay views */
+  if (message_object_own(&request->params.obj[0], request->arena) == -1 ||
+      message_object_own(&request->params.obj[1], request->arena) == -1) {
+    error_set(error, API_ERROR_TYPE_VALIDATION,
+        "Error dispatching run API request. Copying params failed");
+    return (-1);
+  }
+
   if (request->params.obj[0].type == OBJECT_TYPE_ARRAY)
     meta = &request->params.obj[0].data.params;
   else {
@@ -217,7 +240,9 @@ int handle_run(uint64_t con_id, struct message_request *request,
 
   function_name = request->params.obj[1].data.string;
 
-  if (request->params.obj[2].type != OBJECT_TYPE_ARRAY) {
+  /* the arguments are forwarded encoded if they arrived in one piece */
+  if (request->params.obj[2].type != OBJECT_TYPE_ARRAY &&
+      request->params.obj[2].type != OBJECT_TYPE_RAW) {
     error_set(error, API_ERROR_TYPE_VALIDATION,
         "Error dispatching run API request. function string has wrong type");
     return (-1);
@@ -226,10 +251,23 @@ int handle_run(uint64_t con_id, struct message_request *request,
   args_object = request->params.obj[2];
   callid = (uint64_t) randommod(281474976710656LL);
   LOG_VERBOSE(VERBOSE_LEVEL_1, "generated callid %lu\n", callid);
-  hashmap_put(uint64_t, ptr_t)(callids, callid, pluginkey);
+
+  if (!(callerkey = box_strdup(pluginkey)))
+    return (-1);
+
+  uv_mutex_lock(&callidslock);
+  hashmap_put(uint64_t, ptr_t)(callids, callid, callerkey);
+  uv_mutex_unlock(&callidslock);
 
   if (api_run(targetpluginkey, function_name, callid, args_object, con_id,
       request->msgid, error) == -1) {
+    uv_mutex_lock(&callidslock);
+    callerkey = hashmap_del(uint64_t, ptr_t)(callids, callid);
+    uv_mutex_unlock(&callidslock);
+
+    if (callerkey)
+      FREE(callerkey);
+
     if (false == error->isset)
       error_set(error, API_ERROR_TYPE_VALIDATION,
          "Error executing run API request.");
@@ -245,8 +283,8 @@ int handle_result(uint64_t con_id, struct message_request *request,
   uint64_t callid;
   array *meta = NULL;
   struct message_object args_object;
-
-  char * targetpluginkey;
+  char targetpluginkey[PLUGINKEY_STRING_SIZE];
+  char *callerkey;
 
   if (!error || !request)
     return (-1);
@@ -288,7 +326,8 @@ int handle_result(uint64_t con_id, struct message_request *request,
 
   callid = meta->obj[0].data.uinteger;
 
-  if (request->params.obj[1].type != OBJECT_TYPE_ARRAY) {
+  if (request->params.obj[1].type != OBJECT_TYPE_ARRAY &&
+      request->params.obj[1].type != OBJECT_TYPE_RAW) {
     error_set(error, API_ERROR_TYPE_VALIDATION,
         "Error dispatching result API request. function string has wrong type");
     return (-1);
@@ -296,9 +335,16 @@ int handle_result(uint64_t con_id, struct message_request *request,
 
   args_object = request->params.obj[1];
 
-  targetpluginkey = hashmap_get(uint64_t, ptr_t)(callids, callid);
+  /* copied under the lock, another result for the callid may free it */
+  uv_mutex_lock(&callidslock);
+  callerkey = hashmap_get(uint64_t, ptr_t)(callids, callid);
+
+  if (callerkey)
+    strlcpy(targetpluginkey, callerkey, sizeof(targetpluginkey));
 
-  if (!targetpluginkey) {
+  uv_mutex_unlock(&callidslock);
+
+  if (!callerkey) {
     error_set(error, API_ERROR_TYPE_VALIDATION,
       "Failed to find target's key associated with given callid.");
     return (-1);
@@ -312,7 +358,12 @@ int handle_result(uint64_t con_id, struct message_request *request,
     return (-1);
   }
 
-  hashmap_del(uint64_t, ptr_t)(callids, callid);
+  uv_mutex_lock(&callidslock);
+  callerkey = hashmap_del(uint64_t, ptr_t)(callids, callid);
+  uv_mutex_unlock(&callidslock);
+
+  if (callerkey)
+    FREE(callerkey);
 
   return (0);
 }
@@ -330,9 +381,16 @@ dispatch_info dispatch_table_get(string method)
 
 int dispatch_teardown(void)
 {
+  char *callerkey;
+
   hashmap_free(string, dispatch_info)(dispatch_table);
 
+  hashmap_foreach_value(callids, callerkey, {
+    FREE(callerkey);
+  });
+
   hashmap_free(uint64_t, ptr_t)(callids);
+  uv_mutex_destroy(&callidslock);
 
   return (0);
 }
@@ -340,21 +398,21 @@ int dispatch_teardown(void)
 
 int dispatch_table_init(void)
 {
-  dispatch_info register_info = {.func = handle_register, .async = true,
+  dispatch_info register_info = {.func = handle_register, .async = false,
       .name = (string) {.str = "register", .length = sizeof("register") - 1}};
-  dispatch_info run_info = {.func = handle_run, .async = true,
-      .name = (string) {.str = "run", .length = sizeof("run") - 1}};
-  dispatch_info error_info = {.func = handle_error, .async = true,
+  dispatch_info run_info = {.func = handle_run, .async = false,
+      .name = (string) {.str = "run", .length = sizeof("run") - 1},
+      .rawparam = 2};
+  dispatch_info error_info = {.func = handle_error, .async = false,
       .name = (string) {.str = "error", .length = sizeof("error") - 1}};
-  dispatch_info result_info = {.func = handle_result, .async = true,
-      .name = (string) {.str = "result", .length = sizeof("result") - 1,}};
-
-  msgpack_sbuffer_init(&sbuf);
+  dispatch_info result_info = {.func = handle_result, .async = false,
+      .name = (string) {.str = "result", .length = sizeof("result") - 1,},
+      .rawparam = 1};
 
   dispatch_table = hashmap_new(string, dispatch_info)();
   callids = hashmap_new(uint64_t, ptr_t)();
 
-  if (!dispatch_table || !callids)
+  if (!dispatch_table || !callids || uv_mutex_init(&callidslock) != 0)
     return (-1);
 
   dispatch_table_put(register_info.name, register_info);
@@ -35,9 +35,18 @@
 #include "rpc/sb-rpc.h"
 #include "rpc/connection/event.h"
 
-equeue *equeue_root;
-
-int event_initialize(void)
+__thread equeue *equeue_root;
+__thread slab equeueslab = SLAB_INIT("equeue", equeue);
+
+/* runs the root queue after every poll, at most `eventbudget` events */
+static __thread uv_check_t scheduler;
+/* keeps the loop from blocking in poll while events are left over */
+static __thread uv_idle_t spinner;
+static __thread bool schedulerinit = false;
+/* the default of the EventBudget option */
+static __thread unsigned int eventbudget = 64;
+
+int event_initialize(unsigned int budget)
 {
   /* initialize event root queue */
   equeue_root = equeue_new(NULL);
@@ -45,20 +54,27 @@ int event_initialize(void)
   if (!equeue_root)
     return (-1);
 
+  eventbudget = budget;
+
   return 0;
 }
 
 
 equeue *equeue_new(equeue *root)
 {
-  equeue *queue = MALLOC(equeue);
+  equeue *queue = SLAB_MALLOC(&equeueslab, equeue);
 
   if (!queue)
     return (NULL);
 
   queue->root = root;
+  queue->head = 0;
+  queue->count = 0;
+  queue->weight = 1;
+  queue->deficit = 0;
+  queue->isready = false;
 
-  TAILQ_INIT(&queue->head);
+  TAILQ_INIT(&queue->ready);
 
   return (queue);
 }
@@ -71,7 +87,23 @@ equeue *equeue_new(equeue *root)
  */
 bool equeue_empty(equeue *queue)
 {
-  return (TAILQ_EMPTY(&queue->head));
+  if (!queue->root)
+    return (TAILQ_EMPTY(&queue->ready));
+
+  return (queue->count == 0);
+}
+
+
+bool equeue_full(equeue *queue)
+{
+  return (queue->root && queue->count == EQUEUE_CAPACITY);
+}
+
+
+void equeue_set_weight(equeue *queue, unsigned int weight)
+{
+  queue->weight = MAX(weight, 1);
+  queue->deficit = MIN(queue->deficit, queue->weight);
 }
 
 
@@ -84,13 +116,16 @@ int equeue_put(equeue *queue, api_event event)
   if (!queue->root)
     return (-1);
 
-  queue_entry *entry = MALLOC(queue_entry);
-  entry->data.entry.event = event;
-  TAILQ_INSERT_TAIL(&queue->head, entry, node);
+  if (queue->count == EQUEUE_CAPACITY)
+    return (-1);
 
-  entry->data.entry.root = MALLOC(queue_entry);
-  entry->data.entry.root->data.queue = queue;
-  TAILQ_INSERT_TAIL(&queue->root->head, entry->data.entry.root, node);
+  queue->events[(queue->head + queue->count) % EQUEUE_CAPACITY] = event;
+  queue->count++;
+
+  if (!queue->isready) {
+    TAILQ_INSERT_TAIL(&queue->root->ready, queue, node);
+    queue->isready = true;
+  }
 
   return (0);
 }
@@ -99,75 +134,119 @@ int equeue_put(equeue *queue, api_event event)
 api_event equeue_get(equeue *queue)
 {
   api_event event;
-  queue_entry *entry;
 
-  if (equeue_empty(queue)) {
+  if (!equeue_take(queue, &event))
     event.handler = NULL;
-    return (event);
+
+  return (event);
+}
+
+
+/* moves the next event of `queue` to `event`, copying it only once */
+STATIC bool equeue_take(equeue *queue, api_event *event)
+{
+  equeue *child;
+
+  if (equeue_empty(queue))
+    return (false);
+
+  child = queue->root ? queue : TAILQ_FIRST(&queue->ready);
+
+  /* a new turn of the child */
+  if (!child->deficit)
+    child->deficit = child->weight;
+
+  *event = child->events[child->head];
+  child->head = (child->head + 1) % EQUEUE_CAPACITY;
+  child->count--;
+
+  /*
+   * the bookkeeping is done before the event runs, running the last event
+   * of a connection may free its queue
+   */
+  if (!child->count) {
+    child->head = 0;
+    child->deficit = 0;
+    TAILQ_REMOVE(&child->root->ready, child, node);
+    child->isready = false;
+  } else if (!--child->deficit && !queue->root) {
+    /* the turn is over, the child waits for the other ready children */
+    TAILQ_REMOVE(&queue->ready, child, node);
+    TAILQ_INSERT_TAIL(&queue->ready, child, node);
   }
 
+  return (true);
+}
+
+
+void equeue_free(equeue *queue)
+{
+  equeue *child;
+
   if (queue->root) {
-    entry = dequeue_child(queue);
+    if (queue->isready)
+      TAILQ_REMOVE(&queue->root->ready, queue, node);
   } else {
-    entry = dequeue_child_from_root(queue);
+    /* children outliving their root must not touch it anymore */
+    while ((child = TAILQ_FIRST(&queue->ready))) {
+      TAILQ_REMOVE(&queue->ready, child, node);
+      child->isready = false;
+    }
   }
 
-  event = entry->data.entry.event;
-
-  FREE(entry);
-
-  return (event);
+  SLAB_FREE(&equeueslab, queue);
 }
 
 
-STATIC queue_entry *dequeue_child(equeue *queue)
+unsigned int equeue_run_budget(equeue *queue, unsigned int budget)
 {
-  queue_entry *entry;
+  api_event event;
+  unsigned int count = 0;
 
-  entry = TAILQ_FIRST(&queue->head);
-  TAILQ_REMOVE(&queue->head, entry, node);
-  TAILQ_REMOVE(&queue->root->head, entry->data.entry.root, node);
+  while (count < budget && equeue_take(queue, &event)) {
+    count++;
 
-  FREE(entry->data.entry.root);
+    if (event.handler)
+      event.handler(&event.info);
+  }
 
-  return (entry);
+  return (count);
 }
 
 
-STATIC queue_entry *dequeue_child_from_root(equeue *queue)
+int equeue_schedule(equeue *queue)
 {
-  queue_entry *entry, *centry;
-  equeue *cqueue;
+  if (!schedulerinit) {
+    if (uv_check_init(&loop, &scheduler) != 0 ||
+        uv_idle_init(&loop, &spinner) != 0)
+      return (-1);
 
-  entry = TAILQ_FIRST(&queue->head);
-  TAILQ_REMOVE(&queue->head, entry, node);
-  cqueue = entry->data.queue;
-  centry = TAILQ_FIRST(&cqueue->head);
-  TAILQ_REMOVE(&cqueue->head, centry, node);
+    schedulerinit = true;
+  }
 
-  FREE(entry);
+  scheduler.data = queue;
 
-  return (centry);
+  return (uv_check_start(&scheduler, schedule_cb));
 }
 
 
-void equeue_free(equeue *queue)
+STATIC void schedule_cb(uv_check_t *handle)
 {
-  queue_entry *entry;
+  equeue *queue = handle->data;
 
-  if (queue->root) {
-    while (!equeue_empty(queue)) {
-      entry = dequeue_child(queue);
-      FREE(entry);
-    }
-  } else {
-    while (!equeue_empty(queue)) {
-      entry = dequeue_child_from_root(queue);
-      FREE(entry);
-    }
-  }
+  equeue_run_budget(queue, eventbudget);
 
-  FREE(queue);
+  if (equeue_empty(queue)) {
+    uv_check_stop(&scheduler);
+    uv_idle_stop(&spinner);
+  } else
+    uv_idle_start(&spinner, spin_cb);
+}
+
+
+/* the active idle handle alone makes the loop poll without blocking */
+STATIC void spin_cb(UNUSED(uv_idle_t *handle))
+{
 }
 
 
@@ -175,9 +254,7 @@ void equeue_run_events(equeue *queue)
 {
   api_event event;
 
-  while (!equeue_empty(queue)) {
-    event = equeue_get(queue);
-
+  while (equeue_take(queue, &event)) {
     if (event.handler)
       event.handler(&event.info);
   }
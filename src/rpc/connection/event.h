@@ -18,5 +18,6 @@
 
 #include "rpc/sb-rpc.h"
 
-STATIC queue_entry *dequeue_child(equeue *queue);
-STATIC queue_entry *dequeue_child_from_root(equeue *queue);
+STATIC bool equeue_take(equeue *queue, api_event *event);
+STATIC void schedule_cb(uv_check_t *handle);
+STATIC void spin_cb(uv_idle_t *handle);
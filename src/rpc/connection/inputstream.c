@@ -39,25 +39,31 @@
 #include "rpc/sb-rpc.h"
 #include "rpc/connection/inputstream.h"
 
-inputstream *inputstream_new(inputstream_cb cb, uint32_t buffer_size,
+/* drained segments shared by the inputstreams of a thread */
+static __thread kvec_t(unsigned char *) segmentpool;
+
+__thread slab inputstreamslab = SLAB_INIT("inputstream", inputstream);
+
+inputstream *inputstream_new(inputstream_cb cb, size_t maxmem,
     void *data)
 {
-  inputstream *rs = MALLOC(inputstream);
+  inputstream *rs = SLAB_MALLOC(&inputstreamslab, inputstream);
 
   if (rs == NULL)
     return (NULL);
 
   rs->data = data;
   rs->size = 0;
+  rs->maxmem = maxmem;
   rs->cb = cb;
   rs->stream = NULL;
+  rs->paused = false;
   rs->free_handle = false;
 
-  /* initialize circular buffer */
-  rs->circbuf_start = MALLOC_ARRAY(buffer_size, unsigned char);
-  rs->circbuf_read_pos = rs->circbuf_start;
-  rs->circbuf_write_pos = rs->circbuf_start;
-  rs->circbuf_end = rs->circbuf_start + buffer_size;
+  /* segments are only taken from the pool once data arrives */
+  kv_init(rs->segments);
+  rs->readpos = 0;
+  rs->writepos = 0;
 
   return (rs);
 }
@@ -85,6 +91,22 @@ void inputstream_stop(inputstream *istream)
 }
 
 
+void inputstream_pause(inputstream *istream)
+{
+  istream->paused = true;
+  inputstream_stop(istream);
+}
+
+
+void inputstream_resume(inputstream *istream)
+{
+  istream->paused = false;
+
+  if (istream->size < istream->maxmem)
+    inputstream_start(istream);
+}
+
+
 void inputstream_free(inputstream *istream)
 {
   sbassert(istream);
@@ -93,8 +115,9 @@ void inputstream_free(inputstream *istream)
   if (istream->free_handle)
     uv_close((uv_handle_t *)istream->stream, inputstream_close_cb);
 
-  FREE(istream->circbuf_start);
-  FREE(istream);
+  release_segments(istream);
+  kv_destroy(istream->segments);
+  SLAB_FREE(&inputstreamslab, istream);
 }
 
 
@@ -103,67 +126,115 @@ size_t inputstream_pending(inputstream *istream)
   return (istream->size);
 }
 
-unsigned char *inputstream_get_read(inputstream *istream, size_t *read_count)
+
+size_t inputstream_get_view(inputstream *istream,
+    struct inputstream_view *view)
+{
+  view->data[0] = NULL;
+  view->len[0] = 0;
+  view->data[1] = NULL;
+  view->len[1] = 0;
+
+  if (!istream->size)
+    return (0);
+
+  view->data[0] = kv_A(istream->segments, 0) + istream->readpos;
+  view->len[0] = MIN(istream->size,
+      INPUTSTREAM_SEGMENT_SIZE - istream->readpos);
+
+  if (kv_size(istream->segments) > 1) {
+    view->data[1] = kv_A(istream->segments, 1);
+    view->len[1] = MIN(istream->size - view->len[0],
+        INPUTSTREAM_SEGMENT_SIZE);
+  }
+
+  return (istream->size);
+}
+
+
+void inputstream_consume(inputstream *istream, size_t count)
 {
-  if (!inputstream_pending(istream)) {
-    *read_count = 0;
-    return NULL;
+  bool full = (istream->size >= istream->maxmem);
+  size_t n;
+
+  sbassert(count <= istream->size);
+
+  while (count) {
+    n = MIN(count, INPUTSTREAM_SEGMENT_SIZE - istream->readpos);
+    istream->readpos += n;
+    istream->size -= n;
+    count -= n;
+
+    /* give drained segments back to the pool */
+    if (istream->readpos == INPUTSTREAM_SEGMENT_SIZE) {
+      segment_release(kv_A(istream->segments, 0));
+      memmove(istream->segments.obj, istream->segments.obj + 1,
+          (kv_size(istream->segments) - 1) * sizeof(unsigned char *));
+      kv_size(istream->segments)--;
+      istream->readpos = 0;
+    }
   }
 
-  if (istream->circbuf_read_pos < istream->circbuf_write_pos)
-    *read_count = (size_t) (istream->circbuf_write_pos - istream->circbuf_read_pos);
-  else
-    *read_count = (size_t) (istream->circbuf_end - istream->circbuf_read_pos);
+  if (!istream->size)
+    release_segments(istream);
 
-  return istream->circbuf_read_pos;
+  /* reading was stopped because the buffer ran full */
+  if (full && !istream->paused && istream->size < istream->maxmem)
+    inputstream_start(istream);
 }
 
 
 size_t inputstream_read(inputstream *istream, unsigned char *buf, size_t count)
 {
-  size_t dst_size = count;
-  size_t size = dst_size;
-  size_t recent;
-  size_t infinite = 1;
-  size_t size_count;
-  unsigned char *rptr;
+  struct inputstream_view view;
+  size_t copied = 0;
+  size_t n;
+
+  while (copied < count && inputstream_get_view(istream, &view)) {
+    n = MIN(count - copied, view.len[0]);
+    memcpy(buf + copied, view.data[0], n);
+    inputstream_consume(istream, n);
+    copied += n;
+  }
 
-  for (recent = 0; infinite; infinite = 0) {
-    for (rptr = inputstream_get_read(istream, &recent); istream->size;
-        rptr = inputstream_get_read(istream, &recent)) {
-      size_count = MIN(dst_size, recent);
+  return (copied);
+}
 
-      memcpy(buf, rptr, size_count);
 
-      size_t capacity = (size_t)(istream->circbuf_end - istream->circbuf_start);
-      istream->circbuf_read_pos += size_count;
+STATIC unsigned char *segment_acquire(void)
+{
+  if (kv_size(segmentpool))
+    return (kv_pop(segmentpool));
 
-      if (istream->circbuf_read_pos >= istream->circbuf_end)
-        istream->circbuf_read_pos -= capacity;
+  return (MALLOC_ARRAY(INPUTSTREAM_SEGMENT_SIZE, unsigned char));
+}
 
-      bool full = (capacity == istream->size);
-      istream->size -= size_count;
 
-      if (full) {
-        inputstream_start(istream);
-      }
+STATIC void segment_release(unsigned char *segment)
+{
+  if (kv_size(segmentpool) >= INPUTSTREAM_POOL_SIZE) {
+    FREE(segment);
+    return;
+  }
 
-      if (!(dst_size -= size_count)) {
-        return size;
-      }
+  kv_push(unsigned char *, segmentpool, segment);
+}
 
-      buf += size_count;
-    }
-  }
 
-  return size - dst_size;
+/* returns all segments of a drained inputstream, so idle ones pin nothing */
+STATIC void release_segments(inputstream *istream)
+{
+  while (kv_size(istream->segments))
+    segment_release(kv_pop(istream->segments));
+
+  istream->readpos = 0;
+  istream->writepos = 0;
 }
 
 
 STATIC void inputstream_close_cb(uv_handle_t *handle)
 {
-  FREE(handle->data);
-  FREE(handle);
+  streamhandle_free(handle);
 }
 
 
@@ -171,26 +242,33 @@ STATIC void inputstream_alloc_cb(uv_handle_t *handle,
     UNUSED(size_t suggested_size), uv_buf_t *buf)
 {
   inputstream *istream = streamhandle_get_inputstream(handle);
+  unsigned char *segment;
 
-  if (istream->size == (size_t)(istream->circbuf_end -
-      istream->circbuf_start)) {
-    buf->len = 0;
+  buf->len = 0;
+
+  if (istream->size >= istream->maxmem)
     return;
-  }
 
-  if (istream->circbuf_write_pos >= istream->circbuf_read_pos)
-    buf->len = (size_t)(istream->circbuf_end - istream->circbuf_write_pos);
-  else
-    buf->len = (size_t)(istream->circbuf_read_pos - istream->circbuf_write_pos);
+  if (!kv_size(istream->segments) ||
+      istream->writepos == INPUTSTREAM_SEGMENT_SIZE) {
+    segment = segment_acquire();
+
+    if (segment == NULL)
+      return;
+
+    kv_push(unsigned char *, istream->segments, segment);
+    istream->writepos = 0;
+  }
 
-  buf->base = (char*) istream->circbuf_write_pos;
+  buf->base = (char *)kv_A(istream->segments,
+      kv_size(istream->segments) - 1) + istream->writepos;
+  buf->len = INPUTSTREAM_SEGMENT_SIZE - istream->writepos;
 }
 
 
 STATIC void inputstream_read_cb(uv_stream_t *stream, ssize_t nread,
     UNUSED(const uv_buf_t *buf))
 {
-  size_t read;
   inputstream *istream;
 
   istream = streamhandle_get_inputstream((uv_handle_t *)stream);
@@ -200,8 +278,11 @@ STATIC void inputstream_read_cb(uv_stream_t *stream, ssize_t nread,
    * now, or < 0 on error.
    */
   if (nread <= 0) {
-    if (nread != UV_ENOBUFS) {
-      /* no buffer space available */
+    /* don't keep an unused segment around while idle */
+    if (!istream->size)
+      release_segments(istream);
+
+    if (nread < 0 && nread != UV_ENOBUFS) {
       uv_read_stop(stream);
       /* close connection */
       istream->cb(istream, istream->data, true);
@@ -209,18 +290,11 @@ STATIC void inputstream_read_cb(uv_stream_t *stream, ssize_t nread,
     return;
   }
 
-  read = (size_t)nread;
-
-  istream->circbuf_write_pos += read;
-
-  if (istream->circbuf_write_pos >= istream->circbuf_end)
-    istream->circbuf_write_pos -= (size_t)(istream->circbuf_end - istream->circbuf_start);
+  istream->writepos += (size_t)nread;
+  istream->size += (size_t)nread;
 
-  istream->size += read;
-
-  if (!((size_t)(istream->circbuf_end - istream->circbuf_start) - istream->size)) {
+  if (istream->size >= istream->maxmem)
     inputstream_stop(istream);
-  }
 
   istream->cb(istream, istream->data, false);
 }
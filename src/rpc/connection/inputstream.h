@@ -20,4 +20,7 @@
 
 STATIC void inputstream_alloc_cb(uv_handle_t *, size_t, uv_buf_t *);
 STATIC void inputstream_read_cb(uv_stream_t *, ssize_t, const uv_buf_t *);
+STATIC unsigned char *segment_acquire(void);
+STATIC void segment_release(unsigned char *segment);
+STATIC void release_segments(inputstream *istream);
 STATIC void inputstream_close_cb(uv_handle_t *handle);
@@ -0,0 +1,217 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Plugins reconnect often and every initiate packet needs the key shared
+ * by the plugin's long-term key and the server's long-term key. It only
+ * depends on the plugin's key, so it is cached instead of doing the scalar
+ * multiplication again.
+ *
+ * The cache has a fixed number of entries, allocated at once and locked
+ * into memory so the keys are never swapped out. Entries are evicted least
+ * recently used first or once they are older than the TTL, evicted keys are
+ * wiped. All shards share the cache.
+ */
+
+#include <sys/mman.h>
+#include <uv.h>
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "rpc/connection/keycache.h"
+
+#define KEYCACHE_PK_SIZE 32
+#define KEYCACHE_PK_STRING_SIZE (KEYCACHE_PK_SIZE * 2 + 1)
+
+struct keycache_entry {
+  /* base16 encoded public key, the key of the hashmap */
+  char pk[KEYCACHE_PK_STRING_SIZE];
+  unsigned char key[32];
+  uint64_t created;
+  TAILQ_ENTRY(keycache_entry) node;
+};
+
+static struct {
+  struct keycache_entry *entries;
+  size_t size;
+  size_t count;
+  uint64_t ttl;
+  bool locked;
+  hashmap(cstr_t, ptr_t) *map;
+  /* used entries, most recently used first */
+  TAILQ_HEAD(keycache_lru, keycache_entry) lru;
+  TAILQ_HEAD(, keycache_entry) free;
+  uv_mutex_t lock;
+} cache;
+
+int keycache_init(size_t size, uint64_t ttl)
+{
+  if (cache.entries != NULL || size == 0)
+    return (0);
+
+  cache.entries = CALLOC(size, struct keycache_entry);
+
+  if (cache.entries == NULL)
+    return (-1);
+
+  cache.map = hashmap_new(cstr_t, ptr_t)();
+
+  if (cache.map == NULL || uv_mutex_init(&cache.lock) != 0) {
+    if (cache.map)
+      hashmap_free(cstr_t, ptr_t)(cache.map);
+    FREE(cache.entries);
+    return (-1);
+  }
+
+  /* not fatal, RLIMIT_MEMLOCK may be too low for the configured size */
+  cache.locked = (mlock(cache.entries, size * sizeof(*cache.entries)) == 0);
+
+  if (!cache.locked)
+    LOG_WARNING("Failed to lock the key cache into memory.");
+
+  cache.size = size;
+  cache.count = 0;
+  cache.ttl = ttl;
+  TAILQ_INIT(&cache.lru);
+  TAILQ_INIT(&cache.free);
+
+  for (size_t i = 0; i < size; i++)
+    TAILQ_INSERT_TAIL(&cache.free, &cache.entries[i], node);
+
+  return (0);
+}
+
+void keycache_free(void)
+{
+  if (cache.entries == NULL)
+    return;
+
+  sbmemzero(cache.entries, cache.size * sizeof(*cache.entries));
+
+  if (cache.locked)
+    munlock(cache.entries, cache.size * sizeof(*cache.entries));
+
+  hashmap_free(cstr_t, ptr_t)(cache.map);
+  uv_mutex_destroy(&cache.lock);
+  FREE(cache.entries);
+  cache.size = 0;
+  cache.count = 0;
+}
+
+STATIC void keycache_evict(struct keycache_entry *entry)
+{
+  hashmap_del(cstr_t, ptr_t)(cache.map, entry->pk);
+  TAILQ_REMOVE(&cache.lru, entry, node);
+  cache.count--;
+  sbmemzero(entry, sizeof(*entry));
+  TAILQ_INSERT_HEAD(&cache.free, entry, node);
+}
+
+STATIC bool keycache_expired(struct keycache_entry *entry, uint64_t now)
+{
+  return (cache.ttl > 0 && now - entry->created >= cache.ttl);
+}
+
+int keycache_get(unsigned char *key, const unsigned char *pk)
+{
+  struct keycache_entry *entry;
+  char pkstring[KEYCACHE_PK_STRING_SIZE];
+
+  sbassert(key);
+  sbassert(pk);
+
+  if (cache.entries == NULL)
+    return (-1);
+
+  base16_encode(pkstring, sizeof(pkstring), (const char *)pk,
+      KEYCACHE_PK_SIZE);
+
+  uv_mutex_lock(&cache.lock);
+
+  entry = hashmap_get(cstr_t, ptr_t)(cache.map, pkstring);
+
+  if (entry == NULL) {
+    uv_mutex_unlock(&cache.lock);
+    return (-1);
+  }
+
+  if (keycache_expired(entry, uv_hrtime() / 1000000)) {
+    keycache_evict(entry);
+    uv_mutex_unlock(&cache.lock);
+    return (-1);
+  }
+
+  memcpy(key, entry->key, sizeof(entry->key));
+  TAILQ_REMOVE(&cache.lru, entry, node);
+  TAILQ_INSERT_HEAD(&cache.lru, entry, node);
+
+  uv_mutex_unlock(&cache.lock);
+
+  return (0);
+}
+
+void keycache_put(const unsigned char *pk, const unsigned char *key)
+{
+  struct keycache_entry *entry;
+  char pkstring[KEYCACHE_PK_STRING_SIZE];
+
+  sbassert(pk);
+  sbassert(key);
+
+  if (cache.entries == NULL)
+    return;
+
+  base16_encode(pkstring, sizeof(pkstring), (const char *)pk,
+      KEYCACHE_PK_SIZE);
+
+  uv_mutex_lock(&cache.lock);
+
+  entry = hashmap_get(cstr_t, ptr_t)(cache.map, pkstring);
+
+  if (entry != NULL)
+    keycache_evict(entry);
+
+  if (TAILQ_EMPTY(&cache.free))
+    keycache_evict(TAILQ_LAST(&cache.lru, keycache_lru));
+
+  entry = TAILQ_FIRST(&cache.free);
+  TAILQ_REMOVE(&cache.free, entry, node);
+
+  memcpy(entry->pk, pkstring, sizeof(entry->pk));
+  memcpy(entry->key, key, sizeof(entry->key));
+  entry->created = uv_hrtime() / 1000000;
+
+  hashmap_put(cstr_t, ptr_t)(cache.map, entry->pk, entry);
+  TAILQ_INSERT_HEAD(&cache.lru, entry, node);
+  cache.count++;
+
+  uv_mutex_unlock(&cache.lock);
+
+  sbmemzero(pkstring, sizeof(pkstring));
+}
+
+size_t keycache_count(void)
+{
+  size_t count;
+
+  if (cache.entries == NULL)
+    return (0);
+
+  uv_mutex_lock(&cache.lock);
+  count = cache.count;
+  uv_mutex_unlock(&cache.lock);
+
+  return (count);
+}
@@ -0,0 +1,146 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Short-term server keys are generated ahead of time. Answering a hello
+ * packet needs a fresh keypair, which costs a read from /dev/urandom and a
+ * scalar multiplication. A reconnect storm would pay for both on the event
+ * loop before a single cookie goes out, so a background thread keeps a
+ * bounded pool of keypairs topped up and hello handling just takes one.
+ *
+ * `free` counts the empty slots, the refill thread sleeps on it while the
+ * pool is full. Taken keys are wiped from the pool right away.
+ */
+
+#include <uv.h>
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "rpc/connection/keypool.h"
+#include "tweetnacl.h"
+
+struct keypair {
+  unsigned char pk[crypto_box_PUBLICKEYBYTES];
+  unsigned char sk[crypto_box_SECRETKEYBYTES];
+};
+
+static struct {
+  struct keypair *keys;
+  size_t size;
+  size_t count;
+  uv_mutex_t lock;
+  uv_sem_t free;
+  uv_thread_t thread;
+  bool started;
+} pool;
+
+int keypool_init(size_t size)
+{
+  if (pool.started || size == 0)
+    return (0);
+
+  pool.keys = CALLOC(size, struct keypair);
+
+  if (pool.keys == NULL)
+    return (-1);
+
+  pool.size = size;
+  pool.count = 0;
+
+  if (uv_mutex_init(&pool.lock) != 0)
+    goto fail;
+
+  if (uv_sem_init(&pool.free, (unsigned int)size) != 0) {
+    uv_mutex_destroy(&pool.lock);
+    goto fail;
+  }
+
+  if (uv_thread_create(&pool.thread, keypool_refill, NULL) != 0) {
+    uv_sem_destroy(&pool.free);
+    uv_mutex_destroy(&pool.lock);
+    goto fail;
+  }
+
+  pool.started = true;
+
+  return (0);
+
+fail:
+  FREE(pool.keys);
+  pool.size = 0;
+  return (-1);
+}
+
+STATIC void keypool_refill(UNUSED(void *arg))
+{
+  struct keypair key;
+
+  for (;;) {
+    uv_sem_wait(&pool.free);
+
+    if (crypto_box_keypair(key.pk, key.sk) != 0) {
+      uv_sem_post(&pool.free);
+      continue;
+    }
+
+    uv_mutex_lock(&pool.lock);
+    pool.keys[pool.count++] = key;
+    uv_mutex_unlock(&pool.lock);
+
+    sbmemzero(&key, sizeof(key));
+  }
+}
+
+int keypool_pop(unsigned char *pk, unsigned char *sk)
+{
+  struct keypair *key;
+
+  sbassert(pk);
+  sbassert(sk);
+
+  if (pool.started) {
+    uv_mutex_lock(&pool.lock);
+
+    if (pool.count > 0) {
+      key = &pool.keys[--pool.count];
+      memcpy(pk, key->pk, sizeof(key->pk));
+      memcpy(sk, key->sk, sizeof(key->sk));
+      sbmemzero(key, sizeof(*key));
+      uv_mutex_unlock(&pool.lock);
+
+      uv_sem_post(&pool.free);
+      return (0);
+    }
+
+    uv_mutex_unlock(&pool.lock);
+  }
+
+  /* the pool is drained or disabled */
+  return crypto_box_keypair(pk, sk);
+}
+
+size_t keypool_available(void)
+{
+  size_t count;
+
+  if (!pool.started)
+    return (0);
+
+  uv_mutex_lock(&pool.lock);
+  count = pool.count;
+  uv_mutex_unlock(&pool.lock);
+
+  return (count);
+}
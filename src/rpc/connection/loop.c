@@ -35,37 +35,27 @@
 #include "rpc/sb-rpc.h"
 #include "sb-common.h"
 
-static inline void loop_poll_events_until(struct connection *con,
-    bool *condition);
-equeue *equeue_root;
-uv_loop_t loop;
-
-static inline void loop_poll_events_until(struct connection *con,
-    bool *condition)
+void loop_register_call(struct connection *con, struct callinfo *cinfo)
 {
-  while (!*condition) {
-    if (con->queue && !equeue_empty(con->queue)) {
-      equeue_run_events(con->queue);
-    } else {
-      uv_run(&loop, UV_RUN_ONCE);
-      equeue_run_events(equeue_root);
-    }
-  }
+  if (!con->calls)
+    con->calls = hashmap_new(uint64_t, ptr_t)();
+
+  hashmap_put(uint64_t, ptr_t)(con->calls, cinfo->msgid, cinfo);
+  con->pendingcalls++;
 }
 
 
-void loop_wait_for_response(struct connection *con,
-    struct callinfo *cinfo)
+void loop_complete_call(struct connection *con, struct callinfo *cinfo)
 {
+  struct callinfo *pending;
 
-  /* push callinfo to connection callinfo vector */
-  kv_push(struct callinfo *, con->callvector, cinfo);
-  con->pendingcalls++;
+  pending = hashmap_del(uint64_t, ptr_t)(con->calls, cinfo->msgid);
+  sbassert(pending == cinfo);
+  con->pendingcalls--;
 
-  /* wait until requestinfo returned, in time process events */
-  loop_poll_events_until(con, &cinfo->hasresponse);
+  if (cinfo->cb)
+    cinfo->cb(cinfo, cinfo->data);
 
-  /* delete last from callinfo vector */
-  kv_pop(con->callvector);
-  con->pendingcalls--;
+  free_params(cinfo->response.params);
+  FREE(cinfo);
 }
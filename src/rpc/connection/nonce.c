@@ -0,0 +1,225 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Every nonce the server generates with its long-term key comes from a
+ * counter persisted in .keys/noncecounter, so no nonce is used twice, not
+ * even across restarts. Writing the counter costs an fsync, so it is done
+ * for large ranges of nonces at once, on a background thread, while half
+ * of the current range is still left.
+ *
+ * Taking a nonce is a compare-and-swap on `next` below the persisted
+ * `limit`. If the new range continues the current one, the refill thread
+ * just raises `limit`. If another process moved the counter past us, the
+ * new range is left pending until the current one is used up. The thread
+ * that runs out then switches to it by storing `next` before `limit`, so a
+ * thread that sees the new limit sees the new start as well.
+ */
+
+#include <unistd.h>
+#include <uv.h>
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "rpc/connection/nonce.h"
+
+#define NONCE_RANGE 1048576
+
+static uint64_t next;
+static uint64_t limit;
+static bool refilling;
+/* range persisted behind a gap, guarded by lock */
+static bool pending;
+static uint64_t pendinglow;
+static uint64_t pendinghigh;
+/* number of refill attempts, failed ones included */
+static uint64_t refills;
+static uv_sem_t refill;
+static uv_mutex_t lock;
+static uv_cond_t refilled;
+static uv_thread_t thread;
+static bool started;
+
+/* reserves the next range in .keys/noncecounter */
+STATIC int nonce_persist(uint64_t *low, uint64_t *high)
+{
+  unsigned char data[8];
+  int fdlock;
+
+  fdlock = filesystem_open_lock(".keys/lock");
+
+  if (fdlock == -1)
+    return (-1);
+
+  if (filesystem_load(".keys/noncecounter", data, sizeof data) == -1) {
+    close(fdlock);
+    return (-1);
+  }
+
+  *low = uint64_unpack(data);
+  *high = *low + NONCE_RANGE;
+
+  uint64_pack(data, *high);
+
+  if (filesystem_save_sync(".keys/noncecounter", data, sizeof data) == -1) {
+    close(fdlock);
+    return (-1);
+  }
+
+  if (close(fdlock) == -1)
+    return (-1);
+
+  return (0);
+}
+
+STATIC int nonce_refill(void)
+{
+  uint64_t low, high;
+  int result;
+
+  result = nonce_persist(&low, &high);
+
+  uv_mutex_lock(&lock);
+
+  if (result == 0) {
+    if (pending && low == pendinghigh) {
+      pendinghigh = high;
+    } else if (!pending && low == __atomic_load_n(&limit, __ATOMIC_RELAXED)) {
+      __atomic_store_n(&limit, high, __ATOMIC_RELEASE);
+    } else {
+      /* the counter was moved by someone else, the rest of the current
+         range is handed out first */
+      pendinglow = low;
+      pendinghigh = high;
+      __atomic_store_n(&pending, true, __ATOMIC_RELAXED);
+    }
+  }
+
+  refills++;
+  uv_cond_broadcast(&refilled);
+  uv_mutex_unlock(&lock);
+
+  __atomic_store_n(&refilling, false, __ATOMIC_RELEASE);
+
+  return (result);
+}
+
+STATIC void nonce_refill_thread(UNUSED(void *arg))
+{
+  for (;;) {
+    uv_sem_wait(&refill);
+
+    if (nonce_refill() == -1)
+      LOG_ERROR("Failed to reserve nonces.");
+  }
+}
+
+/* switches to the pending range once the range up to `high` is used up,
+   called with lock held */
+STATIC bool nonce_switch(uint64_t high)
+{
+  if (!pending || __atomic_load_n(&limit, __ATOMIC_RELAXED) != high)
+    return (false);
+
+  __atomic_store_n(&next, pendinglow, __ATOMIC_RELAXED);
+  __atomic_store_n(&limit, pendinghigh, __ATOMIC_RELEASE);
+  __atomic_store_n(&pending, false, __ATOMIC_RELAXED);
+
+  return (true);
+}
+
+STATIC void nonce_request_refill(void)
+{
+  bool expected = false;
+
+  if (__atomic_compare_exchange_n(&refilling, &expected, true, false,
+      __ATOMIC_ACQ_REL, __ATOMIC_RELAXED))
+    uv_sem_post(&refill);
+}
+
+int nonce_init(void)
+{
+  if (started)
+    return (0);
+
+  if (uv_mutex_init(&lock) != 0)
+    return (-1);
+
+  if (uv_cond_init(&refilled) != 0 || uv_sem_init(&refill, 0) != 0)
+    return (-1);
+
+  /* the first range is reserved before anything is served */
+  if (nonce_refill() == -1)
+    return (-1);
+
+  uv_mutex_lock(&lock);
+  nonce_switch(0);
+  uv_mutex_unlock(&lock);
+
+  if (uv_thread_create(&thread, nonce_refill_thread, NULL) != 0)
+    return (-1);
+
+  started = true;
+
+  return (0);
+}
+
+int nonce_reserve(uint64_t *counter)
+{
+  uint64_t cur, high, attempt;
+
+  sbassert(counter);
+
+  for (;;) {
+    high = __atomic_load_n(&limit, __ATOMIC_ACQUIRE);
+    cur = __atomic_load_n(&next, __ATOMIC_RELAXED);
+
+    while (cur < high) {
+      if (__atomic_compare_exchange_n(&next, &cur, cur + 1, true,
+          __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        /* `high` may be stale by now, don't reserve a range twice */
+        if (high - cur < NONCE_RANGE / 2 &&
+            !__atomic_load_n(&pending, __ATOMIC_RELAXED) &&
+            __atomic_load_n(&limit, __ATOMIC_ACQUIRE) - cur < NONCE_RANGE / 2)
+          nonce_request_refill();
+
+        *counter = cur;
+        return (0);
+      }
+    }
+
+    /* the range is used up before the next one got persisted */
+    if (!started)
+      return (-1);
+
+    uv_mutex_lock(&lock);
+
+    if (!nonce_switch(high)) {
+      attempt = refills;
+      nonce_request_refill();
+
+      while (refills == attempt &&
+          __atomic_load_n(&limit, __ATOMIC_ACQUIRE) == high)
+        uv_cond_wait(&refilled, &lock);
+
+      nonce_switch(high);
+    }
+
+    uv_mutex_unlock(&lock);
+
+    if (__atomic_load_n(&limit, __ATOMIC_ACQUIRE) == high)
+      return (-1);
+  }
+}
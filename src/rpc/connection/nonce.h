@@ -0,0 +1,25 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "rpc/sb-rpc.h"
+
+STATIC int nonce_persist(uint64_t *low, uint64_t *high);
+STATIC int nonce_refill(void);
+STATIC void nonce_refill_thread(void *arg);
+STATIC bool nonce_switch(uint64_t high);
+STATIC void nonce_request_refill(void);
@@ -38,16 +38,33 @@
 #include "rpc/connection/outputstream.h"
 
 
-outputstream *outputstream_new(uint32_t maxmem)
+/* outputstreams with queued frames, flushed once per loop iteration */
+static __thread kvec_t(outputstream *) flushqueue;
+static __thread uv_prepare_t flusher;
+static __thread bool flusherinit = false;
+
+__thread slab outputstreamslab = SLAB_INIT("outputstream", outputstream);
+__thread slab writerequestslab = SLAB_INIT("writerequest",
+    struct write_request_data);
+
+outputstream *outputstream_new(size_t highwater, size_t lowwater)
 {
-  outputstream *ws = MALLOC(outputstream);
+  outputstream *ws = SLAB_MALLOC(&outputstreamslab, outputstream);
 
   if (ws == NULL)
     return (NULL);
 
-  ws->maxmem = maxmem;
+  ws->highwater = highwater;
+  ws->lowwater = lowwater;
+  ws->congested = false;
+  ws->draincb = NULL;
+  ws->draindata = NULL;
   ws->stream = NULL;
   ws->curmem = 0;
+  ws->inflight = 0;
+  ws->queued = false;
+  ws->freed = false;
+  kv_init(ws->pending);
 
   return (ws);
 }
@@ -60,57 +77,189 @@ void outputstream_set(outputstream *ostream, uv_stream_t *stream)
 }
 
 
+void outputstream_set_drain_cb(outputstream *ostream,
+    outputstream_drain_cb cb, void *data)
+{
+  ostream->draincb = cb;
+  ostream->draindata = data;
+}
+
+
+bool outputstream_congested(outputstream *ostream)
+{
+  return (ostream->congested);
+}
+
+
 void outputstream_free(outputstream *ostream)
 {
-  FREE(ostream);
+  if (!ostream)
+    return;
+
+  /* hand the remaining frames to libuv before the stream gets closed */
+  if (ostream->stream)
+    outputstream_flush(ostream);
+
+  for (size_t i = 0; i < kv_size(ostream->pending); i++)
+    FREE(kv_A(ostream->pending, i).base);
+
+  kv_destroy(ostream->pending);
+  kv_init(ostream->pending);
+
+  /* the last write callback frees the outputstream */
+  ostream->freed = true;
+
+  if (!ostream->inflight && !ostream->queued)
+    SLAB_FREE(&outputstreamslab, ostream);
 }
 
 
 int outputstream_write(outputstream *ostream, char *buffer, size_t len)
 {
   uv_buf_t buf;
-  uv_write_t *req;
-  struct write_request_data *data;
 
-  if ((ostream->curmem + len) > ostream->maxmem)
+  if (ostream->freed)
     return (-1);
 
+  if (!flusherinit) {
+    if (uv_prepare_init(&loop, &flusher) != 0)
+      return (-1);
+
+    /* the flusher alone must not keep the loop alive */
+    uv_unref((uv_handle_t *)&flusher);
+    kv_init(flushqueue);
+    flusherinit = true;
+  }
+
   buf.base = buffer;
   buf.len = len;
+  kv_push(uv_buf_t, ostream->pending, buf);
+
+  /* the frame is queued anyway, the writer is expected to back off */
+  outputstream_reserve(ostream, len);
+
+  if (!ostream->queued) {
+    if (!kv_size(flushqueue))
+      uv_prepare_start(&flusher, flush_cb);
+
+    kv_push(outputstream *, flushqueue, ostream);
+    ostream->queued = true;
+  }
+
+  return (0);
+}
+
+
+void outputstream_reserve(outputstream *ostream, size_t len)
+{
+  ostream->curmem += len;
+
+  if (ostream->curmem > ostream->highwater)
+    ostream->congested = true;
+}
 
-  data = MALLOC(struct write_request_data);
+
+void outputstream_unreserve(outputstream *ostream, size_t len)
+{
+  ostream->curmem -= len;
+
+  if (!ostream->freed)
+    outputstream_drain(ostream);
+}
+
+
+STATIC int outputstream_flush(outputstream *ostream)
+{
+  struct write_request_data *data;
+
+  if (!kv_size(ostream->pending))
+    return (0);
+
+  data = SLAB_MALLOC(&writerequestslab, struct write_request_data);
 
   if (data == NULL)
     return (-1);
 
+  /* the request takes over the queued frames */
   data->ostream = ostream;
-  data->buffer = buffer;
-  data->len = len;
-  req = MALLOC(uv_write_t);
+  data->bufs = ostream->pending.obj;
+  data->nbufs = kv_size(ostream->pending);
+  data->len = 0;
+  data->req.data = data;
 
-  if (req == NULL)
-    return (-1);
+  for (size_t i = 0; i < data->nbufs; i++)
+    data->len += data->bufs[i].len;
 
-  req->data = data;
-  ostream->curmem += len;
+  kv_init(ostream->pending);
 
-  if (uv_write(req, ostream->stream, &buf, 1, write_cb) != 0)
+  if (uv_write(&data->req, ostream->stream, data->bufs,
+      (unsigned int)data->nbufs, write_cb) != 0) {
+    LOG("error on write");
+    ostream->inflight++;
+    write_cb(&data->req, -1);
     return (-1);
+  }
+
+  ostream->inflight++;
 
   return (0);
 }
 
 
+STATIC void flush_cb(UNUSED(uv_prepare_t *handle))
+{
+  outputstream *ostream;
+
+  while (kv_size(flushqueue)) {
+    ostream = kv_pop(flushqueue);
+    ostream->queued = false;
+
+    if (ostream->freed) {
+      if (!ostream->inflight)
+        SLAB_FREE(&outputstreamslab, ostream);
+      continue;
+    }
+
+    outputstream_flush(ostream);
+  }
+
+  uv_prepare_stop(&flusher);
+}
+
+
 STATIC void write_cb(uv_write_t *req, int status)
 {
   struct write_request_data *data = req->data;
+  outputstream *ostream = data->ostream;
 
-  if (status == -1) {
+  if (status < 0)
     LOG("error on write");
+
+  for (size_t i = 0; i < data->nbufs; i++)
+    FREE(data->bufs[i].base);
+
+  FREE(data->bufs);
+  ostream->curmem -= data->len;
+  ostream->inflight--;
+  SLAB_FREE(&writerequestslab, data);
+
+  if (ostream->freed) {
+    if (!ostream->inflight && !ostream->queued)
+      SLAB_FREE(&outputstreamslab, ostream);
     return;
   }
 
-  FREE(req);
-  data->ostream->curmem -= data->len;
-  FREE(data);
+  outputstream_drain(ostream);
+}
+
+
+/* leaves the congested state once the stream drained to lowwater */
+STATIC void outputstream_drain(outputstream *ostream)
+{
+  if (ostream->congested && ostream->curmem <= ostream->lowwater) {
+    ostream->congested = false;
+
+    if (ostream->draincb)
+      ostream->draincb(ostream, ostream->draindata);
+  }
 }
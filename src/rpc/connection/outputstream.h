@@ -18,4 +18,7 @@
 
 #include "rpc/sb-rpc.h"
 
+STATIC int outputstream_flush(outputstream *ostream);
+STATIC void flush_cb(uv_prepare_t *handle);
 STATIC void write_cb(uv_write_t *req, int status);
+STATIC void outputstream_drain(outputstream *ostream);
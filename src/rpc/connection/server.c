@@ -20,6 +20,8 @@
 #include <bsd/string.h>
 #endif
 #include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
 
 #include "sb-common.h"
 #include "rpc/sb-rpc.h"
@@ -46,9 +48,9 @@ struct server {
   } socket;
 };
 
-static hashmap(cstr_t, ptr_t) *servers = NULL;
-
-uv_loop_t loop;
+static __thread hashmap(cstr_t, ptr_t) *servers = NULL;
+/* shard that gets the next connection accepted on a pipe */
+static unsigned int nextshard = 0;
 
 int server_init(void)
 {
@@ -87,6 +89,14 @@ int server_start_tcp(boxaddr *addr, uint16_t port)
       sizeof(struct sockaddr_in));
 
   uv_tcp_init(&loop, &server->socket.tcp.handle);
+
+  /* every shard listens on the address, the kernel balances connections */
+  if (shard_count() > 1 && reuseport_open(&server->socket.tcp.handle,
+      server->socket.tcp.addr.sa_family) != 0) {
+    LOG_WARNING("Failed to open shared socket %s", fmt_addr(addr));
+    return (-1);
+  }
+
   result = uv_tcp_bind(&server->socket.tcp.handle,
       (const struct sockaddr *)&server->socket.tcp.addr, 0);
 
@@ -204,6 +214,7 @@ STATIC void connection_cb(uv_stream_t *server_stream, int status)
   struct sockaddr sockname;
   char hbuf[NI_MAXHOST], sbuf[NI_MAXSERV];
   size_t hbuflen;
+  unsigned int target;
 
   if (status == -1) {
     LOG_ERROR("error on_write_end");
@@ -214,7 +225,7 @@ STATIC void connection_cb(uv_stream_t *server_stream, int status)
   hbuflen = sizeof(hbuf);
 
   server = server_stream->data;
-  client = MALLOC(uv_stream_t);
+  client = streamhandle_alloc();
 
   if (client == NULL)
     return;
@@ -252,6 +263,15 @@ STATIC void connection_cb(uv_stream_t *server_stream, int status)
       return;
     }
     LOG_VERBOSE(VERBOSE_LEVEL_0, "new client connection: host = %s\n", hbuf);
+
+    /* pipes are only accepted on shard 0, spread their connections */
+    target = nextshard++ % shard_count();
+
+    if (target != shard_self()) {
+      if (handoff(client, target) != 0)
+        LOG_ERROR("Failed to hand over connection.");
+      return;
+    }
   }
 
   if (connection_create(client) < 0) {
@@ -261,9 +281,87 @@ STATIC void connection_cb(uv_stream_t *server_stream, int status)
 }
 
 
+/*
+ * Passes the accepted `client` to the shard `index`. The shard takes over a
+ * duplicate of the socket, the handle of this shard is closed.
+ */
+STATIC int handoff(uv_stream_t *client, unsigned int index)
+{
+  uv_os_fd_t fd;
+  int *handed;
+
+  handed = MALLOC(int);
+
+  if (!handed || uv_fileno((uv_handle_t *)client, &fd) != 0 ||
+      (*handed = dup(fd)) < 0) {
+    if (handed)
+      FREE(handed);
+    uv_close((uv_handle_t *)client, client_free_cb);
+    return (-1);
+  }
+
+  uv_close((uv_handle_t *)client, client_free_cb);
+
+  if (shard_post(index, adopt_task, handed) != 0) {
+    close(*handed);
+    FREE(handed);
+    return (-1);
+  }
+
+  return (0);
+}
+
+
+STATIC void adopt_task(void *data)
+{
+  int *fd = data;
+  uv_pipe_t *client;
+
+  client = (uv_pipe_t *)streamhandle_alloc();
+
+  if (client == NULL) {
+    close(*fd);
+    FREE(fd);
+    return;
+  }
+
+  uv_pipe_init(&loop, client, 0);
+
+  if (uv_pipe_open(client, *fd) != 0) {
+    close(*fd);
+    uv_close((uv_handle_t *)client, client_free_cb);
+  } else if (connection_create((uv_stream_t *)client) < 0) {
+    LOG_ERROR("Failed to create connection.");
+    uv_close((uv_handle_t *)client, client_free_cb);
+  }
+
+  FREE(fd);
+}
+
+
+STATIC int reuseport_open(uv_tcp_t *handle, int family)
+{
+  int fd;
+  int on = 1;
+
+  fd = socket(family, SOCK_STREAM, 0);
+
+  if (fd < 0)
+    return (-1);
+
+  if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 ||
+      uv_tcp_open(handle, fd) != 0) {
+    close(fd);
+    return (-1);
+  }
+
+  return (0);
+}
+
+
 STATIC void client_free_cb(uv_handle_t *handle)
 {
-  FREE(handle);
+  streamhandle_free(handle);
 }
 
 
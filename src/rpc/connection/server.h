@@ -21,3 +21,6 @@
 STATIC void connection_cb(uv_stream_t *server_stream, int status);
 STATIC void client_free_cb(uv_handle_t *handle);
 STATIC void server_free_cb(uv_handle_t *handle);
+STATIC int handoff(uv_stream_t *client, unsigned int index);
+STATIC void adopt_task(void *data);
+STATIC int reuseport_open(uv_tcp_t *handle, int family);
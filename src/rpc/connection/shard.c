@@ -0,0 +1,248 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Connections are distributed over `WorkerThreads` shards. Every shard is a
+ * thread running its own event loop (`loop` is thread-local), shard 0 is the
+ * main thread. A connection lives on the shard that accepted it and is only
+ * touched by that thread, other shards hand work over by posting a task to
+ * the inbox of the owning shard.
+ *
+ * The inbox is an intrusive multi-producer single-consumer queue (D. Vyukov),
+ * producers never block each other and the owning shard is woken up with
+ * `uv_async_send()`.
+ */
+
+#include <stdlib.h>
+#include <uv.h>
+
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "rpc/connection/shard.h"
+
+struct shard_task {
+  struct shard_task *next;
+  shard_task_cb cb;
+  void *data;
+};
+
+struct shard {
+  unsigned int index;
+  uv_thread_t thread;
+  uv_async_t wakeup;
+  /* producers append to head, the owning shard pops from tail */
+  struct shard_task *head;
+  struct shard_task *tail;
+  struct shard_task stub;
+};
+
+__thread uv_loop_t loop;
+
+static __thread unsigned int self = 0;
+static struct shard *shards = NULL;
+static unsigned int nshards = 1;
+static shard_setup_cb shardsetup = NULL;
+static uv_sem_t ready;
+static int setupfailed = 0;
+
+int shard_init(unsigned int count)
+{
+  if (count < 1 || count > SHARD_MAX)
+    return (-1);
+
+  nshards = count;
+
+  if (nshards == 1)
+    return (0);
+
+  shards = CALLOC(nshards, struct shard);
+
+  if (!shards)
+    return (-1);
+
+  for (unsigned int i = 0; i < nshards; i++) {
+    shards[i].index = i;
+    shards[i].stub.next = NULL;
+    shards[i].head = &shards[i].stub;
+    shards[i].tail = &shards[i].stub;
+  }
+
+  if (uv_sem_init(&ready, 0) != 0)
+    return (-1);
+
+  /* shard 0 is served by the loop of the calling (main) thread */
+  if (uv_async_init(&loop, &shards[0].wakeup, wakeup_cb) != 0)
+    return (-1);
+
+  shards[0].wakeup.data = &shards[0];
+
+  return (0);
+}
+
+int shard_start(shard_setup_cb setup)
+{
+  if (setup() != 0)
+    return (-1);
+
+  if (nshards == 1)
+    return (0);
+
+  shardsetup = setup;
+
+  for (unsigned int i = 1; i < nshards; i++) {
+    if (uv_thread_create(&shards[i].thread, shard_run, &shards[i]) != 0)
+      return (-1);
+
+    /* the loop and the inbox of the shard are usable from now on */
+    uv_sem_wait(&ready);
+  }
+
+  /*
+   * the listeners are started by the setup tasks, so that no connection is
+   * accepted before every shard is able to receive tasks
+   */
+  for (unsigned int i = 1; i < nshards; i++) {
+    if (shard_post(i, setup_task, NULL) != 0)
+      return (-1);
+  }
+
+  for (unsigned int i = 1; i < nshards; i++)
+    uv_sem_wait(&ready);
+
+  if (__atomic_load_n(&setupfailed, __ATOMIC_ACQUIRE))
+    return (-1);
+
+  LOG_VERBOSE(VERBOSE_LEVEL_0, "started %u worker threads\n", nshards);
+
+  return (0);
+}
+
+unsigned int shard_count(void)
+{
+  return (nshards);
+}
+
+unsigned int shard_self(void)
+{
+  return (self);
+}
+
+int shard_post(unsigned int index, shard_task_cb cb, void *data)
+{
+  struct shard_task *task;
+
+  if (index >= nshards || !shards)
+    return (-1);
+
+  task = MALLOC(struct shard_task);
+
+  if (!task)
+    return (-1);
+
+  task->cb = cb;
+  task->data = data;
+
+  shard_push(&shards[index], task);
+  uv_async_send(&shards[index].wakeup);
+
+  return (0);
+}
+
+STATIC void shard_push(struct shard *shard, struct shard_task *task)
+{
+  struct shard_task *prev;
+
+  __atomic_store_n(&task->next, NULL, __ATOMIC_RELAXED);
+  prev = __atomic_exchange_n(&shard->head, task, __ATOMIC_ACQ_REL);
+  __atomic_store_n(&prev->next, task, __ATOMIC_RELEASE);
+}
+
+/*
+ * Returns the oldest task of the inbox or NULL if the inbox is empty. A task
+ * whose producer is still linking it in is picked up on the next wakeup,
+ * the producer signals the shard after linking.
+ */
+STATIC struct shard_task *shard_pop(struct shard *shard)
+{
+  struct shard_task *tail = shard->tail;
+  struct shard_task *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+  if (tail == &shard->stub) {
+    if (!next)
+      return (NULL);
+
+    shard->tail = next;
+    tail = next;
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+  }
+
+  if (next) {
+    shard->tail = next;
+    return (tail);
+  }
+
+  if (tail != __atomic_load_n(&shard->head, __ATOMIC_ACQUIRE))
+    return (NULL);
+
+  shard_push(shard, &shard->stub);
+  next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+
+  if (next) {
+    shard->tail = next;
+    return (tail);
+  }
+
+  return (NULL);
+}
+
+STATIC void wakeup_cb(uv_async_t *handle)
+{
+  struct shard *shard = handle->data;
+  struct shard_task *task;
+
+  while ((task = shard_pop(shard)) != NULL) {
+    task->cb(task->data);
+    FREE(task);
+  }
+}
+
+STATIC void shard_run(void *arg)
+{
+  struct shard *shard = arg;
+
+  self = shard->index;
+
+  if (uv_loop_init(&loop) != 0 ||
+      uv_async_init(&loop, &shard->wakeup, wakeup_cb) != 0) {
+    LOG_ERROR("Failed to initialize the event loop of shard %u.", self);
+    abort();
+  }
+
+  shard->wakeup.data = shard;
+  uv_sem_post(&ready);
+
+  uv_run(&loop, UV_RUN_DEFAULT);
+}
+
+STATIC void setup_task(UNUSED(void *data))
+{
+  if (shardsetup() != 0) {
+    LOG_WARNING("Failed to set up shard %u.", self);
+    __atomic_store_n(&setupfailed, 1, __ATOMIC_RELEASE);
+  }
+
+  uv_sem_post(&ready);
+}
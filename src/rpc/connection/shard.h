@@ -0,0 +1,28 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "rpc/sb-rpc.h"
+
+struct shard;
+struct shard_task;
+
+STATIC void shard_push(struct shard *shard, struct shard_task *task);
+STATIC struct shard_task *shard_pop(struct shard *shard);
+STATIC void wakeup_cb(uv_async_t *handle);
+STATIC void shard_run(void *arg);
+STATIC void setup_task(void *data);
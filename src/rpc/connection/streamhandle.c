@@ -43,6 +43,40 @@ struct streamhandle {
   outputstream *ostream;
 };
 
+/* accepted clients are either TCP or pipe handles */
+union streamhandle_uv {
+  uv_tcp_t tcp;
+  uv_pipe_t pipe;
+};
+
+__thread slab streamslab = SLAB_INIT("stream", union streamhandle_uv);
+__thread slab streamhandleslab = SLAB_INIT("streamhandle",
+    struct streamhandle);
+
+uv_stream_t *streamhandle_alloc(void)
+{
+  uv_stream_t *stream = (uv_stream_t *)SLAB_MALLOC(&streamslab,
+      union streamhandle_uv);
+
+  if (stream == NULL)
+    return (NULL);
+
+  stream->data = NULL;
+
+  return (stream);
+}
+
+
+void streamhandle_free(uv_handle_t *handle)
+{
+  struct streamhandle *hd = handle->data;
+  union streamhandle_uv *uvhandle = (union streamhandle_uv *)handle;
+
+  SLAB_FREE(&streamhandleslab, hd);
+  SLAB_FREE(&streamslab, uvhandle);
+}
+
+
 void streamhandle_set_inputstream(uv_handle_t *handle, inputstream *istream)
 {
   struct streamhandle *hd = init_streamhandle(handle);
@@ -74,7 +108,7 @@ STATIC struct streamhandle *init_streamhandle(uv_handle_t *handle)
   struct streamhandle *hd;
 
   if (handle->data == NULL) {
-    hd = MALLOC(struct streamhandle);
+    hd = SLAB_MALLOC(&streamhandleslab, struct streamhandle);
 
     if (hd == NULL)
       return (NULL);
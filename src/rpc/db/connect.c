@@ -22,6 +22,8 @@
 #include "rpc/db/sb-db.h"
 #include "sb-common.h"
 
+__thread redisContext *rc = NULL;
+
 int db_connect(const char *ip, int port, const struct timeval tv,
     const char * password)
 {
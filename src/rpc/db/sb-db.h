@@ -18,7 +18,8 @@
 
 #include "rpc/sb-rpc.h"
 
-redisContext *rc;
+/* database connection of the calling thread */
+extern __thread redisContext *rc;
 
 /* DB functions */
 
@@ -16,6 +16,7 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "rpc/msgpack/sb-msgpack-rpc.h"
 #include "sb-common.h"
@@ -139,12 +140,48 @@ int message_serialize_request(struct message_request *req,
 }
 
 
+/*
+ * The exact number of bytes message_serialize_response() and
+ * message_serialize_request() encode to, so that the message can be
+ * encoded right into its packet.
+ */
+size_t message_serialize_response_size(struct message_response *res)
+{
+  /* array header, type, msgid, nil and params */
+  return (1 + 1 + pack_uint_size(res->msgid) + 1 +
+      pack_params_size(res->params));
+}
+
+
+size_t message_serialize_request_size(struct message_request *req)
+{
+  /* array header, type, msgid, method and params */
+  return (1 + 1 + pack_uint_size(req->msgid) +
+      pack_string_size(req->method) + pack_params_size(req->params));
+}
+
+
 int message_deserialize_request(struct message_request *req,
     msgpack_object *obj, struct api_error *api_error)
+{
+  return (message_deserialize_request_view(req, obj, api_error, NULL));
+}
+
+
+/*
+ * As message_deserialize_request(), but the params are decoded as `opts`
+ * say, see unpack_params_view(). The method is taken from the arena of
+ * `opts` too, it is never a view. If this fails, only the arena is left
+ * to be freed.
+ */
+int message_deserialize_request_view(struct message_request *req,
+    msgpack_object *obj, struct api_error *api_error,
+    const struct unpack_options *opts)
 {
   msgpack_object *type, *msgid, *method, *params;
   uint64_t tmp_type;
   uint64_t tmp_msgid;
+  arena *ar = opts ? opts->arena : NULL;
 
   if (!api_error)
     return (-1);
@@ -154,6 +191,8 @@ int message_deserialize_request(struct message_request *req,
     return (-1);
   }
 
+  req->arena = ar;
+
   /* type */
   if (obj->via.array.ptr[0].type != MSGPACK_OBJECT_POSITIVE_INTEGER) {
     error_set(api_error, API_ERROR_TYPE_VALIDATION, "type field has wrong type");
@@ -203,7 +242,7 @@ int message_deserialize_request(struct message_request *req,
     return (-1);
   }
 
-  req->method = unpack_string(method);
+  req->method = unpack_string_arena(method, ar);
 
   if (!req->method.str) {
     error_set(api_error, API_ERROR_TYPE_VALIDATION, "Error unpacking method");
@@ -212,7 +251,8 @@ int message_deserialize_request(struct message_request *req,
 
   /* params */
   if (obj->via.array.ptr[3].type != MSGPACK_OBJECT_ARRAY) {
-    free_string(req->method);
+    if (!ar)
+      free_string(req->method);
     error_set(api_error, API_ERROR_TYPE_VALIDATION, "params field has wrong type");
     return (-1);
   }
@@ -220,13 +260,15 @@ int message_deserialize_request(struct message_request *req,
   params = &obj->via.array.ptr[3];
 
   if (!params) {
-    free_string(req->method);
+    if (!ar)
+      free_string(req->method);
     error_set(api_error, API_ERROR_TYPE_VALIDATION, "unpack params failed");
     return (-1);
   }
 
-  if (unpack_params(params, &req->params) == -1) {
-    free_string(req->method);
+  if (unpack_params_view(params, &req->params, opts) == -1) {
+    if (!ar)
+      free_string(req->method);
     error_set(api_error, API_ERROR_TYPE_VALIDATION, "Error unpacking params");
     return (-1);
   }
@@ -244,6 +286,16 @@ uint64_t message_get_id(msgpack_object *obj)
   return (obj->via.array.ptr[1].via.u64);
 }
 
+
+/* the method of a request, a view into `obj` */
+string message_get_method(msgpack_object *obj)
+{
+  if (obj->via.array.ptr[2].type != MSGPACK_OBJECT_STR)
+    return (string) STRING_INIT;
+
+  return (unpack_string_view(&obj->via.array.ptr[2]));
+}
+
 int message_deserialize_response(struct message_response *res,
     msgpack_object *obj, struct api_error *api_error)
 {
@@ -410,14 +462,18 @@ static void free_message_object(message_object obj)
   case OBJECT_TYPE_BIN:
     /* FALLTHROUGH */
   case OBJECT_TYPE_STR:
-    free_string(obj.data.string);
+    /* FALLTHROUGH */
+  case OBJECT_TYPE_RAW:
+    if (!obj.view)
+      free_string(obj.data.string);
     break;
   case OBJECT_TYPE_BOOL:
     break;
   case OBJECT_TYPE_FLOAT:
     break;
   case OBJECT_TYPE_ARRAY:
-    free_params(obj.data.params);
+    if (!obj.view)
+      free_params(obj.data.params);
     break;
   default:
     return;
@@ -441,7 +497,10 @@ struct message_object message_object_copy(struct message_object obj)
     /* FALLTHROUGH */
   case OBJECT_TYPE_STR:
     return (struct message_object) {.type = OBJECT_TYPE_STR, .data.string =
-        cstring_copy_string(obj.data.string.str) };
+        string_copy(obj.data.string) };
+  case OBJECT_TYPE_RAW:
+    return (struct message_object) {.type = OBJECT_TYPE_RAW, .data.string =
+        string_copy(obj.data.string) };
   case OBJECT_TYPE_ARRAY: {
     array array = ARRAY_INIT;
 
@@ -459,6 +518,96 @@ struct message_object message_object_copy(struct message_object obj)
 }
 
 
+/*
+ * Shares `obj` without copying it, e.g. to forward the params of a request
+ * within another one. The returned object is a view that isn't freed with
+ * the params it is put into, so it must not outlive `obj`; use
+ * message_object_own() to keep it longer.
+ */
+struct message_object message_object_borrow(struct message_object obj)
+{
+  obj.view = true;
+
+  return (obj);
+}
+
+
+/*
+ * Replaces the views in `obj` by NUL-terminated copies, so that they can be
+ * used as C strings and outlive the zone they point into. Borrowed arrays
+ * are replaced by deep copies. The string copies are taken from `ar` if it
+ * isn't NULL, pass the arena of the request `obj` belongs to.
+ *
+ * @return 0 on success, -1 otherwise
+ */
+int message_object_own(struct message_object *obj, arena *ar)
+{
+  string copy;
+
+  if (obj->view && obj->type == OBJECT_TYPE_ARRAY) {
+    *obj = message_object_copy(*obj);
+    return (0);
+  }
+
+  if (obj->type == OBJECT_TYPE_ARRAY) {
+    for (size_t i = 0; i < obj->data.params.size; i++) {
+      if (message_object_own(&obj->data.params.obj[i], ar) == -1)
+        return (-1);
+    }
+  }
+
+  if (!obj->view)
+    return (0);
+
+  if (ar) {
+    copy.length = obj->data.string.length;
+
+    if ((copy.str = arena_alloc(ar, copy.length + 1))) {
+      memcpy(copy.str, obj->data.string.str, copy.length);
+      copy.str[copy.length] = '\0';
+    }
+  } else
+    copy = string_copy(obj->data.string);
+
+  if (!copy.str)
+    return (-1);
+
+  obj->data.string = copy;
+  obj->view = false;
+
+  return (0);
+}
+
+
+bool params_have_views(array params)
+{
+  for (size_t i = 0; i < params.size; i++) {
+    if (params.obj[i].view || (params.obj[i].type == OBJECT_TYPE_ARRAY &&
+        params_have_views(params.obj[i].data.params)))
+      return (true);
+  }
+
+  return (false);
+}
+
+
+/*
+ * Frees the method and params of a request, in one step if they were taken
+ * from an arena.
+ */
+void message_request_free(struct message_request *req)
+{
+  if (req->arena) {
+    arena_free(req->arena);
+    req->arena = NULL;
+    return;
+  }
+
+  free_params(req->params);
+  free_string(req->method);
+}
+
+
 void free_params(array params)
 {
   for (size_t i = 0; i < params.size; i++)
@@ -199,6 +199,10 @@ int pack_params(msgpack_packer *pk, array params)
     case (OBJECT_TYPE_BIN):
       pack_string(pk, object->data.string);
       continue;
+    case (OBJECT_TYPE_RAW):
+      if (pack_raw(pk, object->data.string) == -1)
+        return (-1);
+      continue;
     default:
       return (-1);
     }
@@ -206,3 +210,134 @@ int pack_params(msgpack_packer *pk, array params)
 
   return (0);
 }
+
+
+/*
+ * Appends `raw`, an element that is encoded already, without looking at it.
+ */
+int pack_raw(msgpack_packer *pk, string raw)
+{
+  if (!pk || !raw.str)
+    return (-1);
+
+  return (pk->callback(pk->data, raw.str, raw.length) == 0 ? 0 : -1);
+}
+
+
+/*
+ * Writes into the fixed size buffer `data`, a struct pack_buffer, instead of
+ * growing one. Use as msgpack_packer callback.
+ *
+ * @return 0 on success, -1 if the buffer is too small
+ */
+int pack_buffer_write(void *data, const char *buf, size_t len)
+{
+  struct pack_buffer *buffer = data;
+
+  if (len > buffer->size - buffer->used)
+    return (-1);
+
+  memcpy(buffer->data + buffer->used, buf, len);
+  buffer->used += len;
+
+  return (0);
+}
+
+
+/*
+ * The following return the number of bytes the pack functions above
+ * encode their arguments to, in the smallest msgpack format that fits,
+ * as msgpack-c does.
+ */
+
+size_t pack_uint_size(uint64_t uinteger)
+{
+  if (uinteger < (1ULL << 7))
+    return (1);
+  else if (uinteger < (1ULL << 8))
+    return (2);
+  else if (uinteger < (1ULL << 16))
+    return (3);
+  else if (uinteger < (1ULL << 32))
+    return (5);
+
+  return (9);
+}
+
+
+size_t pack_int_size(int64_t integer)
+{
+  if (integer >= 0)
+    return (pack_uint_size((uint64_t)integer));
+  else if (integer >= -(1LL << 5))
+    return (1);
+  else if (integer >= -(1LL << 7))
+    return (2);
+  else if (integer >= -(1LL << 15))
+    return (3);
+  else if (integer >= -(1LL << 31))
+    return (5);
+
+  return (9);
+}
+
+
+size_t pack_string_size(string str)
+{
+  if (str.length < (1ULL << 8))
+    return (2 + str.length);
+  else if (str.length < (1ULL << 16))
+    return (3 + str.length);
+
+  return (5 + str.length);
+}
+
+
+size_t pack_params_size(array params)
+{
+  size_t size;
+
+  if (params.size < 16)
+    size = 1;
+  else if (params.size < (1ULL << 16))
+    size = 3;
+  else
+    size = 5;
+
+  for (size_t i = 0; i < params.size; i++) {
+    message_object *object = &params.obj[i];
+
+    switch (object->type) {
+    case (OBJECT_TYPE_NIL):
+      /*  FALLTHROUGH */
+    case (OBJECT_TYPE_BOOL):
+      size += 1;
+      continue;
+    case (OBJECT_TYPE_INT):
+      size += pack_int_size(object->data.integer);
+      continue;
+    case (OBJECT_TYPE_UINT):
+      size += pack_uint_size(object->data.uinteger);
+      continue;
+    case (OBJECT_TYPE_FLOAT):
+      size += 9;
+      continue;
+    case (OBJECT_TYPE_ARRAY):
+      size += pack_params_size(object->data.params);
+      continue;
+    case (OBJECT_TYPE_STR):
+      /*  FALLTHROUGH */
+    case (OBJECT_TYPE_BIN):
+      size += pack_string_size(object->data.string);
+      continue;
+    case (OBJECT_TYPE_RAW):
+      size += object->data.string.length;
+      continue;
+    default:
+      /* pack_params() fails on these */
+      continue;
+    }
+  }
+
+  return (size);
+}
@@ -45,6 +45,13 @@
  * --------------------------------------------------------------------
  */
 
+/* fixed size buffer for pack_buffer_write() */
+struct pack_buffer {
+  char *data;
+  size_t size;
+  size_t used;
+};
+
 /* Functions */
 
 int message_unpack_type(msgpack_object *obj, struct message_request *req,
@@ -80,12 +87,19 @@ int message_pack_msgid(msgpack_packer *pk, uint32_t msgid);
 
 
 string unpack_string(msgpack_object *obj);
+string unpack_string_arena(msgpack_object *obj, arena *ar);
+string unpack_string_view(msgpack_object *obj);
 char * unpack_bin(msgpack_object *obj);
 int64_t unpack_int(msgpack_object *obj);
 uint64_t unpack_uint(msgpack_object *obj);
 bool unpack_boolean(msgpack_object *obj);
 double unpack_float(msgpack_object *obj);
 int unpack_params(msgpack_object *obj, array *params);
+int unpack_params_view(msgpack_object *obj, array *params,
+    const struct unpack_options *opts);
+int unpack_raw_skip(string raw, size_t *off);
+int unpack_raw_param(string raw, size_t index, string *param);
+int unpack_raw_params(string raw, array *params);
 
 
 
@@ -102,3 +116,9 @@ int pack_nil(msgpack_packer *pk);
 int pack_bool(msgpack_packer *pk, bool boolean);
 int pack_float(msgpack_packer *pk, double floating);
 int pack_params(msgpack_packer *pk, array params);
+int pack_raw(msgpack_packer *pk, string raw);
+int pack_buffer_write(void *data, const char *buf, size_t len);
+size_t pack_uint_size(uint64_t uinteger);
+size_t pack_int_size(int64_t integer);
+size_t pack_string_size(string str);
+size_t pack_params_size(array params);
@@ -15,6 +15,7 @@
  */
 
 #include <msgpack/object.h>
+#include <msgpack/zone.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -47,6 +48,38 @@ string unpack_string(msgpack_object *obj)
 }
 
 
+/*
+ * As unpack_string(), but the copy is taken from `ar` if it isn't NULL.
+ */
+string unpack_string_arena(msgpack_object *obj, arena *ar)
+{
+  char *ret;
+
+  if (!ar)
+    return (unpack_string(obj));
+
+  if (!obj->via.bin.ptr ||
+      !(ret = arena_alloc(ar, (size_t)obj->via.bin.size + 1)))
+    return (string) STRING_INIT;
+
+  memcpy(ret, obj->via.bin.ptr, obj->via.bin.size);
+  ret[obj->via.bin.size] = '\0';
+
+  return (string) {.str = ret, .length = obj->via.bin.size};
+}
+
+
+/*
+ * Unlike unpack_string() the returned string isn't a copy, it points into the
+ * zone `obj` was unpacked into and isn't NUL-terminated.
+ */
+string unpack_string_view(msgpack_object *obj)
+{
+  return (string) {.str = (char *)obj->via.bin.ptr,
+      .length = obj->via.bin.size};
+}
+
+
 int64_t unpack_int(msgpack_object *obj)
 {
   return (obj->via.i64);
@@ -73,12 +106,37 @@ double unpack_float(msgpack_object *obj)
 
 int unpack_params(msgpack_object *obj, array *params)
 {
+  return (unpack_params_view(obj, params, NULL));
+}
+
+
+/*
+ * As unpack_params(), but decoded as `opts` say, NULL decodes and copies
+ * everything like unpack_params(). Objects and copied strings taken from
+ * `opts->arena` are freed with it instead of by free_params(). Views
+ * point into the zone of `obj` and the raw request, both have to outlive
+ * `params`.
+ */
+int unpack_params_view(msgpack_object *obj, array *params,
+    const struct unpack_options *opts)
+{
+  static const struct unpack_options copyall = {NULL, 0, STRING_INIT, 0};
+  struct unpack_options nested;
   struct message_object *elem;
   msgpack_object *tmp;
+  arena *ar;
 
   if (!params)
     return (-1);
 
+  if (!opts)
+    opts = &copyall;
+
+  /* only elements of the request's params themselves are kept encoded */
+  nested = *opts;
+  nested.rawparam = 0;
+  ar = opts->arena;
+
   /* if array is empty return success */
   if (obj->via.array.size <= 0) {
     params->obj = NULL;
@@ -86,7 +144,12 @@ int unpack_params(msgpack_object *obj, array *params)
     return (0);
   }
 
-  params->obj = CALLOC(obj->via.array.size, struct message_object);
+  if (ar)
+    params->obj = arena_calloc(ar, obj->via.array.size,
+        sizeof(struct message_object));
+  else
+    params->obj = CALLOC(obj->via.array.size, struct message_object);
+
   params->size = obj->via.array.size;
   
   if (!params->obj)
@@ -96,6 +159,14 @@ int unpack_params(msgpack_object *obj, array *params)
     tmp = &obj->via.array.ptr[i];
     elem = &params->obj[i];
 
+    if (opts->rawparam && i == opts->rawparam &&
+        tmp->type == MSGPACK_OBJECT_ARRAY &&
+        unpack_raw_param(opts->raw, i, &elem->data.string) == 0) {
+      elem->type = OBJECT_TYPE_RAW;
+      elem->view = true;
+      continue;
+    }
+
     switch (tmp->type) {
     case MSGPACK_OBJECT_POSITIVE_INTEGER:
       elem->type = OBJECT_TYPE_UINT;
@@ -109,7 +180,12 @@ int unpack_params(msgpack_object *obj, array *params)
       /* FALLTHROUGH */
     case MSGPACK_OBJECT_BIN:
       elem->type = OBJECT_TYPE_STR;
-      elem->data.string = unpack_string(tmp);
+      if (opts->viewthreshold &&
+          tmp->via.bin.size >= opts->viewthreshold) {
+        elem->view = true;
+        elem->data.string = unpack_string_view(tmp);
+      } else
+        elem->data.string = unpack_string_arena(tmp, ar);
       continue;
     case MSGPACK_OBJECT_BOOLEAN:
       elem->type = OBJECT_TYPE_BOOL;
@@ -124,7 +200,7 @@ int unpack_params(msgpack_object *obj, array *params)
       continue;
     case MSGPACK_OBJECT_ARRAY:
       elem->type = OBJECT_TYPE_ARRAY;
-      if (unpack_params(tmp, &elem->data.params) == -1)
+      if (unpack_params_view(tmp, &elem->data.params, &nested) == -1)
         return (-1);
       continue;
     case MSGPACK_OBJECT_MAP:
@@ -138,3 +214,280 @@ int unpack_params(msgpack_object *obj, array *params)
 
   return (0);
 }
+
+
+/* reads the `length` byte big endian number at `p` */
+static uint64_t raw_number(const unsigned char *p, size_t length)
+{
+  uint64_t ret = 0;
+
+  for (size_t i = 0; i < length; i++)
+    ret = (ret << 8) | p[i];
+
+  return (ret);
+}
+
+
+/*
+ * Reads the header of the encoded element at `*off` and moves `*off` past
+ * it. `*tag` is the first byte of the element, `*payload` the number of
+ * bytes following the header that belong to the element itself (strings,
+ * binaries, extension data and numbers) and `*children` the number of
+ * elements following it (array elements, map keys and values).
+ *
+ * @return 0 on success, -1 if `raw` ends within the header or is invalid
+ */
+static int raw_header(string raw, size_t *off, uint8_t *tag, size_t *payload,
+    uint64_t *children)
+{
+  const unsigned char *p = (const unsigned char *)raw.str + *off;
+  size_t left = raw.length - *off;
+  size_t length = 0;
+
+  if (*off >= raw.length)
+    return (-1);
+
+  *tag = p[0];
+  *payload = 0;
+  *children = 0;
+
+  if (*tag <= 0x7f || *tag >= 0xe0 || *tag == 0xc0 || *tag == 0xc2 ||
+      *tag == 0xc3) {
+    /* fixint, nil, bool */
+  } else if (*tag <= 0x8f) {
+    *children = 2 * (uint64_t)(*tag & 0x0f);
+  } else if (*tag <= 0x9f) {
+    *children = *tag & 0x0f;
+  } else if (*tag <= 0xbf) {
+    *payload = *tag & 0x1f;
+  } else if (*tag >= 0xc4 && *tag <= 0xc6) {
+    length = (size_t)1 << (*tag - 0xc4);
+  } else if (*tag >= 0xc7 && *tag <= 0xc9) {
+    /* the extension type follows the length */
+    length = (size_t)1 << (*tag - 0xc7);
+    *payload = 1;
+  } else if (*tag == 0xca || *tag == 0xcb) {
+    *payload = *tag == 0xca ? 4 : 8;
+  } else if (*tag >= 0xcc && *tag <= 0xd3) {
+    *payload = (size_t)1 << ((*tag - 0xcc) & 0x03);
+  } else if (*tag >= 0xd4 && *tag <= 0xd8) {
+    *payload = ((size_t)1 << (*tag - 0xd4)) + 1;
+  } else if (*tag >= 0xd9 && *tag <= 0xdb) {
+    length = (size_t)1 << (*tag - 0xd9);
+  } else if (*tag == 0xdc || *tag == 0xdd || *tag == 0xde || *tag == 0xdf) {
+    length = (*tag & 0x01) ? 4 : 2;
+  } else
+    return (-1);
+
+  if (1 + length > left)
+    return (-1);
+
+  if (*tag >= 0xdc && *tag <= 0xdf) {
+    *children = raw_number(p + 1, length);
+    if (*tag >= 0xde)
+      *children *= 2;
+  } else if (length)
+    *payload += raw_number(p + 1, length);
+
+  *off += 1 + length;
+
+  return (0);
+}
+
+
+/*
+ * Moves `*off` past the encoded element at `*off`, nested elements are
+ * skipped by their headers.
+ *
+ * @return 0 on success, -1 if `raw` ends within the element or is invalid
+ */
+int unpack_raw_skip(string raw, size_t *off)
+{
+  uint64_t pending = 1, children;
+  size_t payload;
+  uint8_t tag;
+
+  while (pending--) {
+    if (raw_header(raw, off, &tag, &payload, &children) != 0 ||
+        payload > raw.length - *off)
+      return (-1);
+
+    *off += payload;
+    pending += children;
+  }
+
+  return (0);
+}
+
+
+/*
+ * Finds the element `index` of the params of the encoded request `raw`.
+ *
+ * @param param  set to the encoded element, a view into `raw`
+ * @return 0 on success, -1 otherwise
+ */
+int unpack_raw_param(string raw, size_t index, string *param)
+{
+  uint64_t children;
+  size_t off = 0, start, payload;
+  uint8_t tag;
+
+  if (!raw.str)
+    return (-1);
+
+  /* [type, msgid, method, params] */
+  if (raw_header(raw, &off, &tag, &payload, &children) != 0 ||
+      children != MESSAGE_REQUEST_ARRAY_SIZE)
+    return (-1);
+
+  for (int i = 0; i < 3; i++) {
+    if (unpack_raw_skip(raw, &off) != 0)
+      return (-1);
+  }
+
+  if (raw_header(raw, &off, &tag, &payload, &children) != 0 ||
+      !((tag & 0xf0) == 0x90 || tag == 0xdc || tag == 0xdd) ||
+      index >= children)
+    return (-1);
+
+  for (size_t i = 0; i < index; i++) {
+    if (unpack_raw_skip(raw, &off) != 0)
+      return (-1);
+  }
+
+  start = off;
+
+  if (unpack_raw_skip(raw, &off) != 0)
+    return (-1);
+
+  *param = (string) {.str = raw.str + start, .length = off - start};
+
+  return (0);
+}
+
+
+/*
+ * Decodes the elements of the encoded array `raw` by their headers only, for
+ * type checks. Numbers, booleans and nil get their values, strings and
+ * arrays only their type and no data. Free `params` with free_params().
+ *
+ * @return 0 on success, -1 if `raw` isn't an array or has unsupported types
+ */
+int unpack_raw_params(string raw, array *params)
+{
+  const unsigned char *p;
+  message_object *elem;
+  uint64_t children, value;
+  size_t off = 0, payload;
+  uint8_t tag;
+
+  if (!raw.str || raw_header(raw, &off, &tag, &payload, &children) != 0 ||
+      !((tag & 0xf0) == 0x90 || tag == 0xdc || tag == 0xdd) ||
+      children > raw.length)
+    return (-1);
+
+  *params = (array) ARRAY_INIT;
+
+  if (!children)
+    return (0);
+
+  params->obj = CALLOC(children, struct message_object);
+
+  if (!params->obj)
+    return (-1);
+
+  params->size = children;
+
+  for (size_t i = 0; i < params->size; i++) {
+    elem = &params->obj[i];
+    p = (const unsigned char *)raw.str + off;
+
+    if (raw_header(raw, &off, &tag, &payload, &children) != 0 ||
+        payload > raw.length - off)
+      goto fail;
+
+    value = raw_number(p + 1, tag >= 0xcc && tag <= 0xd3 ? payload : 0);
+
+    if (tag <= 0x7f || (tag >= 0xcc && tag <= 0xcf)) {
+      elem->type = OBJECT_TYPE_UINT;
+      elem->data.uinteger = tag <= 0x7f ? tag : value;
+    } else if (tag >= 0xe0 || (tag >= 0xd0 && tag <= 0xd3)) {
+      if (tag >= 0xe0)
+        elem->data.integer = (int8_t)tag;
+      else if (payload == 8)
+        elem->data.integer = (int64_t)value;
+      else
+        elem->data.integer = (int64_t)value -
+            ((value >> (8 * payload - 1)) ? (int64_t)1 << (8 * payload) : 0);
+
+      /* non-negative integers are unsigned, as with msgpack_unpack() */
+      if (elem->data.integer >= 0) {
+        elem->type = OBJECT_TYPE_UINT;
+        elem->data.uinteger = (uint64_t)elem->data.integer;
+      } else
+        elem->type = OBJECT_TYPE_INT;
+    } else if (tag == 0xc0) {
+      elem->type = OBJECT_TYPE_NIL;
+    } else if (tag == 0xc2 || tag == 0xc3) {
+      elem->type = OBJECT_TYPE_BOOL;
+      elem->data.boolean = tag == 0xc3;
+    } else if (tag == 0xca || tag == 0xcb) {
+      elem->type = OBJECT_TYPE_FLOAT;
+    } else if ((tag >= 0xa0 && tag <= 0xbf) || (tag >= 0xc4 && tag <= 0xc6) ||
+        (tag >= 0xd9 && tag <= 0xdb)) {
+      elem->type = OBJECT_TYPE_STR;
+    } else if ((tag & 0xf0) == 0x90 || tag == 0xdc || tag == 0xdd) {
+      elem->type = OBJECT_TYPE_ARRAY;
+    } else
+      goto fail;
+
+    /* step back and skip the whole element */
+    off = (size_t)(p - (const unsigned char *)raw.str);
+
+    if (unpack_raw_skip(raw, &off) != 0)
+      goto fail;
+  }
+
+  return (0);
+
+fail:
+  free_params(*params);
+  return (-1);
+}
+
+
+struct unpack_zone *unpack_zone_new(msgpack_zone *zone)
+{
+  struct unpack_zone *ret;
+
+  if (!zone)
+    return (NULL);
+
+  ret = MALLOC(struct unpack_zone);
+
+  if (!ret) {
+    msgpack_zone_free(zone);
+    return (NULL);
+  }
+
+  ret->zone = zone;
+  ret->refcount = 1;
+
+  return (ret);
+}
+
+
+void unpack_zone_ref(struct unpack_zone *zone)
+{
+  zone->refcount++;
+}
+
+
+void unpack_zone_unref(struct unpack_zone *zone)
+{
+  if (!zone || --zone->refcount)
+    return;
+
+  msgpack_zone_free(zone->zone);
+  FREE(zone);
+}
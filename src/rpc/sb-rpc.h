@@ -44,11 +44,16 @@
 typedef struct outputstream   outputstream;
 typedef struct inputstream inputstream;
 typedef int (*inputstream_cb)(inputstream *inputstream, void *data, bool eof);
+typedef void (*outputstream_drain_cb)(outputstream *outputstream, void *data);
 typedef struct api_event api_event;
 typedef struct equeue equeue;
-typedef struct queue_entry queue_entry;
 typedef struct message_object message_object;
 typedef struct connection_request_event_info connection_request_event_info;
+typedef struct callinfo callinfo;
+typedef void (*callinfo_cb)(callinfo *cinfo, void *data);
+typedef void (*shard_task_cb)(void *data);
+typedef int (*shard_setup_cb)(void);
+typedef void (*crypto_unbox_cb)(int status, uint64_t plaintextlen, void *data);
 
 
 #define MESSAGE_REQUEST_ARRAY_SIZE 4
@@ -57,9 +62,25 @@ typedef struct connection_request_event_info connection_request_event_info;
 #define MESSAGE_TYPE_RESPONSE 1
 #define MESSAGE_RESPONSE_UNKNOWN UINT32_MAX
 
-#define STREAM_BUFFER_SIZE 0xffff
-
-#define CALLINFO_INIT (struct callinfo) {0, false, false,((struct message_response) {0, ARRAY_INIT})}
+/* inputstreams buffer their data in segments of this size */
+#define INPUTSTREAM_SEGMENT_SIZE 0x4000
+/* drained segments kept in the shared pool for reuse by other inputstreams */
+#define INPUTSTREAM_POOL_SIZE 1024
+/* serialization buffers kept in the pool for reuse by other connections */
+#define SBUF_POOL_SIZE 64
+/* events a child event queue holds before equeue_put() fails */
+#define EQUEUE_CAPACITY 8
+/* upper bound of the PluginWeight of a plugin */
+#define PLUGIN_WEIGHT_MAX 1000
+/* buffers that grew beyond this size are freed instead of being pooled */
+#define SBUF_POOL_MAX_ALLOC (1024 * 1024)
+/* unpackers of closed connections kept in the pool for new connections */
+#define UNPACKER_POOL_SIZE 64
+/* unpackers whose buffer grew beyond this size are freed instead */
+#define UNPACKER_POOL_MAX_BUFFER (1024 * 1024)
+/* upper bound of worker threads, connection ids encode their shard */
+#define SHARD_MAX 256
+#define SHARD_OF(id) ((unsigned int)((id) % SHARD_MAX))
 
 
 /*
@@ -82,6 +103,8 @@ typedef enum {
   OBJECT_TYPE_STR,
   OBJECT_TYPE_BIN,
   OBJECT_TYPE_ARRAY,
+  /* an encoded array in `string`, forwarded as it is */
+  OBJECT_TYPE_RAW,
 } message_object_type;
 
 typedef enum {
@@ -90,6 +113,19 @@ typedef enum {
   TUNNEL_ESTABLISHED
 } crypto_state;
 
+typedef enum {
+  FRAME_HEADER,
+  FRAME_BODY,
+  FRAME_UNBOXING
+} frame_state;
+
+/* hashmap declarations needed by the structs below */
+
+/* callid -> pluginkey
+ * connection id -> connection
+ * msgid -> pending callinfo */
+MAP_DECLS(uint64_t, ptr_t)
+
 /* Structs */
 
 typedef struct {
@@ -100,6 +136,10 @@ typedef struct {
 
 struct message_object {
   message_object_type type;
+  /* the string points into a pinned unpacker zone and isn't NUL-terminated,
+     or the array is borrowed from the caller, see message_object_own() and
+     message_object_borrow(). Views aren't freed with their parent. */
+  bool view;
   union {
     int64_t integer;
     uint64_t uinteger;
@@ -115,6 +155,8 @@ struct message_request {
   uint32_t msgid;
   string method;
   array params;
+  /* method and params are taken from it if set, see message_request_free() */
+  arena *arena;
 };
 
 struct message_response {
@@ -122,6 +164,25 @@ struct message_response {
   array params;
 };
 
+/* how message_deserialize_request_view() decodes the params of a request */
+struct unpack_options {
+  /* objects and copied strings are taken from it if set */
+  arena *arena;
+  /* strings of at least this size are views, 0 copies all */
+  size_t viewthreshold;
+  /* the encoded request, and the params element that is kept encoded as
+     OBJECT_TYPE_RAW view into it, 0 for none */
+  string raw;
+  size_t rawparam;
+};
+
+/* unpacker zone that message_object views point into, it is freed with its
+   last reference */
+struct unpack_zone {
+  msgpack_zone *zone;
+  size_t refcount;
+};
+
 /*****************************************************************************
  * The following crypto_context structure should be considered PRIVATE to    *
  * the rpc connection layer. No non-rpc connection layer code should be      *
@@ -130,6 +191,11 @@ struct message_response {
 #define PLUGINKEY_SIZE 8
 #define PLUGINKEY_STRING_SIZE ((PLUGINKEY_SIZE * 2) + 1)
 #define CLIENTLONGTERMPK_ARRAY_SIZE 32
+/* 8 byte identifier, 8 byte compressed nonce and 24 byte boxed length */
+#define CRYPTO_HEADER_SIZE 40
+/* a packet is boxed in place, its plaintext starts behind the boxed length
+   and the 32 byte zero-padding of the nacl api */
+#define CRYPTO_PACKET_OFFSET 56
 
 struct crypto_context {
   crypto_state state;
@@ -139,43 +205,54 @@ struct crypto_context {
   unsigned char clientshorttermpk[32];
   unsigned char servershorttermpk[32];
   unsigned char servershorttermsk[32];
-  unsigned char minutekey[32];
-  unsigned char lastminutekey[32];
   char pluginkeystring[PLUGINKEY_STRING_SIZE];
+  /* packets boxed on the threadpool, written in nonce order */
+  struct crypto_queue *queue;
 };
 
 struct connection {
   uint64_t id;
   uint32_t msgid;
   uint32_t pendingcalls;
+  /* number of congested connections this connection's reading waits for */
+  uint32_t pausecount;
   size_t refcount;
   msgpack_unpacker *mpac;
+  /* serialization buffer, taken from the pool on the first send */
   msgpack_sbuffer *sbuf;
-  char *unpackbuf;
   bool closed;
+  /* reading paused because the request queue is full */
+  bool stalled;
   equeue *queue;
   struct {
     inputstream *read;
     outputstream *write;
     uv_stream_t *uv;
   } streams;
-  kvec_t(struct callinfo *) callvector;
+  /* msgid -> pending callinfo, allocated on the first call */
+  hashmap(uint64_t, ptr_t) *calls;
+  /* ids of connections paused until the output of this connection drained */
+  kvec_t(uint64_t) paused;
   struct crypto_context cc;
+  /* framing state of the incoming message packet */
   struct {
-    uint64_t start;
-    uint64_t end;
-    uint64_t pos;
+    frame_state state;
     uint64_t length;
-    unsigned char *data;
+    uint64_t pos;
   } packet;
-  uv_timer_t minutekey_timer;
 };
 
+/*
+ * A request the server sent to a plugin and that still waits for its
+ * response. `cb` is called from the event loop once the response arrived or
+ * the connection to the plugin failed (`errorresponse` is set then).
+ */
 struct callinfo {
   uint32_t msgid;
-  bool hasresponse;
   bool errorresponse;
   struct message_response response;
+  callinfo_cb cb;
+  void *data;
 };
 
 typedef int (*apidispatchwrapper)(uint64_t con_id,
@@ -186,30 +263,55 @@ typedef struct {
   apidispatchwrapper func;
   bool async;
   string name;
+  /* params element that is only forwarded, see struct unpack_options */
+  size_t rawparam;
 } dispatch_info;
 
 struct outputstream {
   uv_stream_t *stream;
   size_t curmem;
-  uint32_t maxmem;
+  /* congested above highwater until drained to lowwater */
+  size_t highwater;
+  size_t lowwater;
+  bool congested;
+  outputstream_drain_cb draincb;
+  void *draindata;
+  /* frames queued since the last flush, owned by the outputstream */
+  kvec_t(uv_buf_t) pending;
+  /* number of uv_write requests not yet completed */
+  size_t inflight;
+  bool queued;
+  bool freed;
 };
 
 struct write_request_data {
+  uv_write_t req;
   outputstream *ostream;
-  char *buffer;
+  uv_buf_t *bufs;
+  size_t nbufs;
   size_t len;
 };
 
+/* the first two segments of the pending data of an inputstream */
+struct inputstream_view {
+  unsigned char *data[2];
+  size_t len[2];
+};
+
 struct inputstream {
   void * data;
   char * buffer;
   uv_stream_t * stream;
   inputstream_cb cb;
-  unsigned char *circbuf_start;
-  unsigned char *circbuf_end;
-  unsigned char *circbuf_read_pos;
-  unsigned char *circbuf_write_pos;
+  /* segments taken from the shared pool, data is read from the first one */
+  kvec_t(unsigned char *) segments;
+  /* read offset in the first and write offset in the last segment */
+  size_t readpos;
+  size_t writepos;
   size_t size;
+  size_t maxmem;
+  /* reading paused by backpressure, independent of maxmem */
+  bool paused;
   bool free_handle;
 };
 
@@ -217,6 +319,8 @@ struct inputstream {
 struct connection_request_event_info {
   struct connection *con;
   struct message_request request;
+  /* zone the views in request point into, NULL if there are none */
+  struct unpack_zone *zone;
   dispatch_info dispatcher;
   struct api_error api_error;
 };
@@ -228,30 +332,31 @@ struct api_event {
   void (*handler)(connection_request_event_info *info);
 };
 
-TAILQ_HEAD(queue, queue_entry);
+TAILQ_HEAD(equeue_ready, equeue);
 
+/*
+ * A child queue (one per connection) keeps its events in a ring of
+ * EQUEUE_CAPACITY events. While it has events it is linked into the ready
+ * list of its root queue. The root serves its ready children with deficit
+ * round robin: a child's turn lasts up to `weight` events.
+ */
 struct equeue {
-  struct queue head;
   equeue *root;
-};
-
-struct queue_entry {
-  union {
-    equeue *queue;
-    struct {
-      queue_entry *root;
-      api_event event;
-    } entry;
-  } data;
-  TAILQ_ENTRY(queue_entry) node;
+  /* root queue: children with pending events, served in turn */
+  struct equeue_ready ready;
+  /* child queue: ring of pending events */
+  api_event events[EQUEUE_CAPACITY];
+  unsigned int head;
+  unsigned int count;
+  unsigned int weight;
+  /* events left in the current turn of the child, 0 between turns */
+  unsigned int deficit;
+  bool isready;
+  TAILQ_ENTRY(equeue) node;
 };
 
 /* hashmap declarations */
 
-/* callid -> pluginkey
- * connection id -> connection */
-MAP_DECLS(uint64_t, ptr_t)
-
 /* pluginkey -> connection
  * formatted address to listen to -> server */
 MAP_DECLS(cstr_t, ptr_t)
@@ -262,8 +367,16 @@ MAP_DECLS(string, dispatch_info)
 /* pluginkey -> connection id */
 MAP_DECLS(cstr_t, uint64_t)
 
-/* define global root event queue */
-extern equeue *equeue_root;
+/* define root event queue of the calling thread */
+extern __thread equeue *equeue_root;
+
+/* slabs of the objects every connection of the calling thread allocates */
+extern __thread slab streamslab;
+extern __thread slab streamhandleslab;
+extern __thread slab inputstreamslab;
+extern __thread slab outputstreamslab;
+extern __thread slab writerequestslab;
+extern __thread slab equeueslab;
 
 
 /* Functions */
@@ -275,6 +388,23 @@ extern equeue *equeue_root;
  */
 int connection_init(void);
 
+/**
+ * Initialize the connection state of a worker thread. `connection_init()`
+ * does this for the calling thread.
+ *
+ * @return 0 on success, -1 otherwise
+ */
+int connection_thread_init(void);
+
+/**
+ * Preallocate the objects of `count` connections for the calling thread, so
+ * that a burst of new connections doesn't wait for malloc.
+ *
+ * @param count Number of connections
+ * @return 0 on success, -1 otherwise
+ */
+int connection_prewarm(size_t count);
+
 /**
  * Create a API connection from a libuv stream (tcp or pipe/socket client
  * connection)
@@ -284,24 +414,74 @@ int connection_init(void);
  */
 int connection_create(uv_stream_t *stream);
 
-struct callinfo connection_send_request(char *pluginkey, string method,
-    array params, struct api_error *api_error);
+/**
+ * Send a request to the plugin identified by `pluginkey` without waiting for
+ * its response. `cb` is called with `data` as soon as the response arrived
+ * (or the plugin connection failed), the event loop keeps running meanwhile.
+ * `params` are freed in any case, borrowed objects in them are left to their
+ * owner (see message_object_borrow()). If the plugin is connected to another
+ * shard, the request is handed over to that shard and a failure to send it
+ * is reported to `cb`.
+ *
+ * @return 0 if the request was sent, -1 otherwise (`cb` is never called then)
+ */
+int connection_send_request(char *pluginkey, string method, array params,
+    callinfo_cb cb, void *data, struct api_error *api_error);
 int connection_send_response(uint64_t con_id, uint32_t msgid,
     array params, struct api_error *api_error);
+int connection_send_error_response(uint64_t con_id, uint32_t msgid,
+    struct api_error *api_error);
 int connection_hashmap_put(uint64_t id, struct connection *con);
 int pluginkeys_hashmap_put(char *pluginkey, uint64_t id);
-void loop_wait_for_response(struct connection *con,
-    struct callinfo *cinfo);
+
+/**
+ * Register a sent request as pending call of `con`. Pending calls are
+ * indexed by msgid, responses may arrive in any order.
+ *
+ * @param con The connection the request was sent to
+ * @param cinfo The `callinfo` instance, owned by `con` from now on
+ */
+void loop_register_call(struct connection *con, struct callinfo *cinfo);
+
+/**
+ * Remove a pending call from `con`, run its callback and free it
+ *
+ * @param con The connection the request was sent to
+ * @param cinfo The `callinfo` instance with response or error set
+ */
+void loop_complete_call(struct connection *con, struct callinfo *cinfo);
 int connection_teardown(void);
 
 /**
  * Create a new `outputstream` instance. A `outputstream` instance contains the
  * logic to write to a libuv stream
  *
- * @param maxmem Maximum amount of memory used by the new `outputstream` instance
+ * @param highwater Amount of queued data above which the stream is congested
+ * @param lowwater Amount of queued data the stream has to drain to before
+ *                 the drain callback is called
  * @return The created `outputstream` instance
  */
-outputstream *outputstream_new(uint32_t maxmem);
+outputstream *outputstream_new(size_t highwater, size_t lowwater);
+
+/**
+ * Set the callback that is called once a congested `outputstream` drained
+ * to its low watermark
+ *
+ * @param outputstream The `outputstream` instance
+ * @param cb The drain callback
+ * @param data Data passed to the callback
+ */
+void outputstream_set_drain_cb(outputstream *outputstream,
+    outputstream_drain_cb cb, void *data);
+
+/**
+ * Check whether more data than the high watermark is queued on the
+ * `outputstream` instance
+ *
+ * @param outputstream The `outputstream` instance
+ * @return true if the stream is congested
+ */
+bool outputstream_congested(outputstream *outputstream);
 
 /**
  * Associate a `uv_stream_t` instance
@@ -318,18 +498,51 @@ void outputstream_set(outputstream *outputstream, uv_stream_t *stream);
  */
 void outputstream_free(outputstream *outputstream);
 
+/**
+ * Queue a frame for writing. Frames queued within one loop iteration are
+ * flushed together as a single vectored write. Frames are queued even if
+ * the stream is congested, see `outputstream_congested`.
+ *
+ * On success the `outputstream` takes ownership of `buffer` and frees it
+ * once the write completed. On failure the caller still owns `buffer`.
+ *
+ * @param outputstream The `outputstream` instance
+ * @param buffer Heap allocated frame to write
+ * @param len Length of the frame
+ * @return 0 on success, -1 otherwise
+ */
 int outputstream_write(outputstream *outputstream, char *buffer, size_t len);
 
+/**
+ * Count `len` bytes that are going to be written to the `outputstream`
+ * later, e.g. a frame still being boxed, towards its queued data. The
+ * stream gets congested as if they were queued already.
+ *
+ * @param outputstream The `outputstream` instance
+ * @param len Number of bytes to count
+ */
+void outputstream_reserve(outputstream *outputstream, size_t len);
+
+/**
+ * Stop counting `len` bytes counted by `outputstream_reserve`, once they
+ * were written or dropped. The drain callback is called if the stream
+ * drained this way.
+ *
+ * @param outputstream The `outputstream` instance
+ * @param len Number of bytes to stop counting
+ */
+void outputstream_unreserve(outputstream *outputstream, size_t len);
+
 /**
  * Create a new inputstream instance. A inputstream contains the logic to read
  * from a libuv stream.
  *
  * @param cb Callback function that will be called when data is available
- * @param buffer_size Size of the internal Buffer
+ * @param maxmem Maximum amount of pending data, reading is paused above it
  * @param data An object or state to associate with the inputstream instance
  * @return The created `inputstream` instance
  */
-inputstream *inputstream_new(inputstream_cb cb, uint32_t buffer_size,
+inputstream *inputstream_new(inputstream_cb cb, size_t maxmem,
     void *data);
 
 /**
@@ -355,30 +568,33 @@ void inputstream_start(inputstream *inputstream);
 void inputstream_stop(inputstream *inputstream);
 
 /**
- * Free the memory of the `inputstream` instance
+ * Pause reading from the `inputstream` instance until it is resumed,
+ * regardless of how much data is buffered
  *
  * @param inputstream The `inputstream` instance
  */
-void inputstream_free(inputstream *inputstream);
+void inputstream_pause(inputstream *inputstream);
 
 /**
- * Return the number of bytes pending for reading for the `inputstream` instance
+ * Resume reading from a paused `inputstream` instance
  *
  * @param inputstream The `inputstream` instance
  */
-size_t inputstream_pending(inputstream *inputstream);
+void inputstream_resume(inputstream *inputstream);
 
 /**
- * Get the number of bytes that can be read from the `inputstream` instance
- * and the start pointer to the data that can be read
+ * Free the memory of the `inputstream` instance
  *
  * @param inputstream The `inputstream` instance
- * @param read_count A pointer to an the read count integer variable
-
- * @return The data pointer
  */
-unsigned char *inputstream_get_read(inputstream *istream, size_t *read_count);
+void inputstream_free(inputstream *inputstream);
 
+/**
+ * Return the number of bytes pending for reading for the `inputstream` instance
+ *
+ * @param inputstream The `inputstream` instance
+ */
+size_t inputstream_pending(inputstream *inputstream);
 
 /**
  * Read data from the `inputstream` instance into a buffer
@@ -391,6 +607,27 @@ unsigned char *inputstream_get_read(inputstream *istream, size_t *read_count);
 size_t inputstream_read(inputstream *inputstream, unsigned char *buf,
     size_t count);
 
+/**
+ * Get a view of the pending data of the `inputstream` instance without
+ * copying it. The view covers the first two buffer segments, more data
+ * may be pending behind them.
+ *
+ * @param inputstream The `inputstream` instance
+ * @param[out] view The view to fill
+ * @return The number of pending bytes
+ */
+size_t inputstream_get_view(inputstream *inputstream,
+    struct inputstream_view *view);
+
+/**
+ * Drop data from the `inputstream` instance, e.g. after it was processed
+ * in place through a view
+ *
+ * @param inputstream The `inputstream` instance
+ * @param count The number of bytes to drop
+ */
+void inputstream_consume(inputstream *inputstream, size_t count);
+
 /**
  * Initialize a Server Instance
  *
@@ -421,7 +658,32 @@ int server_start_pipe(char *name);
 int server_stop(char * endpoint);
 int server_close(void);
 
-int event_initialize(void);
+int event_initialize(unsigned int budget);
+
+/**
+ * Prepare `count` shards, each with its own event loop. Shard 0 is the
+ * calling thread, its `loop` must be initialized already.
+ *
+ * @return 0 on success, -1 otherwise
+ */
+int shard_init(unsigned int count);
+
+/**
+ * Run `setup` on every shard and start the worker threads.
+ *
+ * @return 0 if all shards are set up, -1 otherwise
+ */
+int shard_start(shard_setup_cb setup);
+unsigned int shard_count(void);
+unsigned int shard_self(void);
+
+/**
+ * Run `cb` with `data` on the event loop of shard `index`. This is the only
+ * way to touch connections owned by another shard.
+ *
+ * @return 0 on success, -1 otherwise
+ */
+int shard_post(unsigned int index, shard_task_cb cb, void *data);
 
 /**
  * create a new queue or child queue
@@ -439,21 +701,20 @@ equeue * equeue_new(equeue *root);
  * an empty event object. if it's not empty the first queue entry will be
  * returned and removed from the queue.
  *
- * if the queue entry is a child, the first child queue entry is returned and
- * removed from the child queue. after that, the child queue entry associated
- * event is returned.
- *
- * if the queue entry is no child. the queue entry associated event is returned
+ * on a child queue the oldest event of the child is returned. on the root
+ * queue the oldest event of the first ready child is returned, the child
+ * moves to the end of the ready list, so that children are served in turn.
  *
  * @param queue queue instance
  */
 api_event equeue_get(equeue *queue);
 
 /**
- * put an event in a queue
+ * put an event in a child queue, neither allocates nor frees memory
  *
  * @param queue queue instance
  * @param event event to enqueue
+ * @returns 0 on success, -1 for the root queue or if the child is full
  */
 int equeue_put(equeue *queue, api_event event);
 
@@ -464,6 +725,36 @@ int equeue_put(equeue *queue, api_event event);
  */
 void equeue_run_events(equeue *queue);
 
+/**
+ * run at most `budget` events of a queue, children of a root queue are
+ * served in turn according to their weight
+ *
+ * @params queue queue instance
+ * @params budget maximum number of events to run
+ * @returns the number of events run
+ */
+unsigned int equeue_run_budget(equeue *queue, unsigned int budget);
+
+/**
+ * run the events of a root queue from the event loop of the calling thread.
+ * after every poll of the loop the events are run within the budget passed
+ * to event_initialize(), the loop doesn't block while events are left.
+ *
+ * @params queue root queue instance
+ * @returns 0 on success, -1 otherwise
+ */
+int equeue_schedule(equeue *queue);
+
+/**
+ * set the number of events a child queue may run in one turn
+ *
+ * @params queue child queue instance
+ * @params weight weight of the child, at least 1
+ */
+void equeue_set_weight(equeue *queue, unsigned int weight);
+
+bool equeue_full(equeue *queue);
+
 /**
  * free queue
  *
@@ -476,6 +767,22 @@ bool equeue_empty(equeue *queue);
 
 
 
+/**
+ * Allocate a libuv stream handle big enough for a TCP or a pipe handle. The
+ * handle is taken from the slab of the calling thread.
+ *
+ * @return the uninitialized handle or NULL if out of memory
+ */
+uv_stream_t *streamhandle_alloc(void);
+
+/**
+ * Free a closed handle allocated by streamhandle_alloc() together with the
+ * stream state attached to it, to be used as uv_close() callback.
+ *
+ * @param handle The closed handle
+ */
+void streamhandle_free(uv_handle_t *handle);
+
 void streamhandle_set_inputstream(uv_handle_t *handle,
     inputstream *inputstream);
 void streamhandle_set_outputstream(uv_handle_t *handle,
@@ -507,25 +814,124 @@ int message_serialize_response(struct message_response *res,
     msgpack_packer *pk);
 int message_deserialize_request(struct message_request *req,
     msgpack_object *obj, struct api_error *api_error);
+int message_deserialize_request_view(struct message_request *req,
+    msgpack_object *obj, struct api_error *api_error,
+    const struct unpack_options *opts);
+void message_request_free(struct message_request *req);
 int message_deserialize_response(struct message_response *res,
     msgpack_object *obj, struct api_error *api_error);
 int message_deserialize_error_response(struct message_response *res,
     msgpack_object *obj, struct api_error *api_error);
 int message_serialize_request(struct message_request *req, msgpack_packer *pk);
+size_t message_serialize_response_size(struct message_response *res);
+size_t message_serialize_request_size(struct message_request *req);
 void message_dispatch(msgpack_object *req, msgpack_packer *res);
 uint64_t message_get_id(msgpack_object *obj);
+string message_get_method(msgpack_object *obj);
 bool message_is_error_response(msgpack_object *obj);
 struct message_object message_object_copy(struct message_object obj);
+struct message_object message_object_borrow(struct message_object obj);
+int message_object_own(struct message_object *obj, arena *ar);
+bool params_have_views(array params);
+
+/**
+ * Wraps the zone of an unpacked message, so that views of its strings can
+ * outlive the next msgpack_unpacker_next() call. The caller holds the first
+ * reference.
+ *
+ * @param zone  zone taken with msgpack_unpacked_release_zone()
+ * @return the wrapped zone or NULL on failure, `zone` is freed then
+ */
+struct unpack_zone *unpack_zone_new(msgpack_zone *zone);
+void unpack_zone_ref(struct unpack_zone *zone);
+void unpack_zone_unref(struct unpack_zone *zone);
 
 
 
 /**
- * Currently only loads the server private key.
+ * Loads the server private key and the offload threshold, starts filling
+ * the pool of short-term keypairs and sets up the shared key cache.
  *
  * @return 0 on success otherwise -1
  */
 int crypto_init(void);
 
+/**
+ * Start a thread that keeps up to `size` short-term keypairs generated
+ * in advance. Does nothing if `size` is 0 or the pool is running already.
+ *
+ * @return 0 on success otherwise -1
+ */
+int keypool_init(size_t size);
+
+/**
+ * Take a keypair from the pool, the pool's copy is wiped. If the pool is
+ * empty, a keypair is generated on the spot.
+ *
+ * @param pk  public key output (32 bytes)
+ * @param sk  secret key output (32 bytes)
+ * @return 0 on success otherwise -1
+ */
+int keypool_pop(unsigned char *pk, unsigned char *sk);
+
+/**
+ * @return the number of keypairs ready in the pool
+ */
+size_t keypool_available(void);
+
+/**
+ * Reserve the first range of nonce counters in .keys/noncecounter and
+ * start the thread that reserves the next ranges in the background.
+ * Does nothing if it is running already.
+ *
+ * @return 0 on success otherwise -1
+ */
+int nonce_init(void);
+
+/**
+ * Take the next unused nonce counter. Only waits for the disk if the
+ * reserved range is used up before the next one got persisted.
+ *
+ * @param counter  nonce counter output
+ * @return 0 on success, -1 if no nonces could be reserved
+ */
+int nonce_reserve(uint64_t *counter);
+
+/**
+ * Set up the cache of keys shared with the long-term keys of plugins.
+ * Does nothing if `size` is 0 or the cache is set up already.
+ *
+ * @param size  maximum number of cached keys
+ * @param ttl   milliseconds a key stays cached, 0 for no limit
+ * @return 0 on success otherwise -1
+ */
+int keycache_init(size_t size, uint64_t ttl);
+
+/**
+ * Wipe all cached keys and release the cache.
+ */
+void keycache_free(void);
+
+/**
+ * Look up the key shared with the plugin long-term key `pk`.
+ *
+ * @param key  shared key output (32 bytes)
+ * @param pk   plugin long-term public key (32 bytes)
+ * @return 0 on a hit, -1 if the key is not cached (anymore)
+ */
+int keycache_get(unsigned char *key, const unsigned char *pk);
+
+/**
+ * Cache the key shared with the plugin long-term key `pk`, evicting the
+ * least recently used key if the cache is full.
+ */
+void keycache_put(const unsigned char *pk, const unsigned char *key);
+
+/**
+ * @return the number of cached keys
+ */
+size_t keycache_count(void);
+
 /**
  * Verfify if data has a message packet identifier and get the packet length
  *
@@ -561,7 +967,8 @@ int crypto_recv_hello_send_cookie(struct crypto_context *cc,
  * Handle a client message packet and unbox it's data
  *
  * @param cc The crypto_context connection crypto information (nonce etc.)
- * @param in Buffer containing a client message packet
+ * @param in Buffer containing a client message packet, the packet is unboxed
+ *           in place and wiped afterwards
  * @param[out] out Buffer for unboxed data
  * @param length The 'in' buffer length
  * @param[out] plaintextlen The packet length
@@ -571,7 +978,46 @@ int crypto_read(struct crypto_context *cc, unsigned char *in, char *out,
     uint64_t length, uint64_t *plaintextlen);
 
 /**
- * Box data into a server message packet send it
+ * Unbox the body of a client message packet in place
+ *
+ * @param cc The crypto_context connection crypto information (nonce etc.)
+ * @param box crypto_box_BOXZEROBYTES zero bytes followed by the packet body,
+ *            the plaintext starts at box + crypto_box_ZEROBYTES afterwards
+ * @param length The length of the whole packet (including the header)
+ * @param[out] plaintextlen The plaintext length
+ * returns -1 in case of error otherwise 0
+ */
+int crypto_unbox(struct crypto_context *cc, unsigned char *box,
+    uint64_t length, uint64_t *plaintextlen);
+
+/**
+ * Like `crypto_unbox()`, but the packet body is unboxed on the threadpool.
+ * `box` must stay untouched until `cb` was called on the loop.
+ *
+ * @param cc The crypto_context connection crypto information (nonce etc.)
+ * @param box crypto_box_BOXZEROBYTES zero bytes followed by the packet body
+ * @param length The length of the whole packet (including the header)
+ * @param cb Called with the status and the plaintext length
+ * @param data Passed to `cb`
+ * returns -1 if the job could not be queued otherwise 0
+ */
+int crypto_unbox_async(struct crypto_context *cc, unsigned char *box,
+    uint64_t length, crypto_unbox_cb cb, void *data);
+
+/**
+ * Whether packets of `length` bytes are boxed and unboxed on the threadpool
+ * rather than on the loop (see `CryptoOffloadThreshold`).
+ */
+bool crypto_offload(uint64_t length);
+
+/**
+ * Drop the packets of `cc` still being boxed, they are not written anymore.
+ */
+void crypto_close(struct crypto_context *cc);
+
+/**
+ * Box data into a server message packet send it. Large packets are boxed on
+ * the threadpool, packets are written in nonce order in any case.
  *
  * @param cc The crypto_context connection crypto information (nonce etc.)
  * @param data Buffer containing data
@@ -582,7 +1028,32 @@ int crypto_read(struct crypto_context *cc, unsigned char *in, char *out,
 int crypto_write(struct crypto_context *cc, char *data,
     size_t length, outputstream *out);
 
-void crypto_update_minutekey(struct crypto_context *cc);
+/**
+ * As crypto_write(), but the `length` bytes of data are encoded into
+ * `packet` at CRYPTO_PACKET_OFFSET already, so they aren't copied. `packet`
+ * has to be CRYPTO_PACKET_OFFSET + `length` bytes long and is owned by the
+ * crypto layer from now on, it is freed in any case.
+ *
+ * returns -1 in case of error otherwise 0
+ */
+int crypto_write_packet(struct crypto_context *cc, unsigned char *packet,
+    size_t length, outputstream *out);
+
+/**
+ * Start replacing the minute key of the calling shard every minute. Cookies
+ * are boxed with the minute key, a cookie stays valid until its key was
+ * replaced twice. The keys are shared by all connections of the shard, so a
+ * connection keeps no state for its cookie.
+ *
+ * @return 0 on success otherwise -1
+ */
+int crypto_minutekey_start(void);
+
+/**
+ * Replace the minute key of the calling shard, the current one becomes the
+ * last one.
+ */
+void crypto_update_minutekey(void);
 
 /**
  * Pack uint64_t into 8 byte
@@ -209,6 +209,34 @@ typedef struct {
   server_type apitype;
 
   char *ContactInfo;
+
+  /** Maximum amount of unparsed data buffered per connection. */
+  uint64_t ConnectionInputBufferMax;
+  /** Maximum size of a message packet received from a plugin. */
+  uint64_t ConnectionPacketMax;
+  /** Queued output above which connections feeding it stop being read. */
+  uint64_t ConnectionOutputHighWatermark;
+  /** Queued output below which those connections are read again. */
+  uint64_t ConnectionOutputLowWatermark;
+  /** Number of threads serving plugin connections, each with its own loop. */
+  int WorkerThreads;
+  /** Packets of at least this size are (un)boxed off the event loop. */
+  uint64_t CryptoOffloadThreshold;
+  /** Number of short-term keypairs generated ahead of time. */
+  int EphemeralKeyPool;
+  /** Number of keys shared with plugin long-term keys that are cached. */
+  int KeyCacheSize;
+  /** Seconds a shared key stays cached. */
+  int KeyCacheTTL;
+  /** Connections whose objects are preallocated by every shard. */
+  int ConnectionPrewarm;
+  /** Events a shard runs per loop iteration before it polls again. */
+  int EventBudget;
+  /** Plugin keys and the share of the event loop their plugins get. */
+  configline *PluginWeight;
+  /** Request strings of at least this size aren't copied out of the
+   * unpacker, 0 copies all of them. */
+  uint64_t ZeroCopyThreshold;
   /** Ports to listen on for SOCKS connections. */
   uint16_t RedisPort;
 } options;
@@ -232,11 +260,47 @@ struct unit_table_t {
 typedef void * ptr_t;
 typedef const char * cstr_t;
 
+/* statistics of a slab, see slab_alloc() */
+struct slab_stats {
+  uint64_t allocs;
+  uint64_t frees;
+  uint64_t inuse;
+  uint64_t peak;
+  uint64_t available;
+  uint64_t chunks;
+};
+
+/* freelist of objects of one type, usually thread-local */
+typedef struct slab {
+  const char *name;
+  size_t size;
+  void *freelist;
+  void *chunks;
+  struct slab_stats stats;
+} slab;
+
+/* sizes arenas of one kind of message grew to, see arena_new() */
+#define ARENA_HISTOGRAM_BUCKETS 16
+struct arena_histogram {
+  uint64_t counts[ARENA_HISTOGRAM_BUCKETS];
+  uint64_t total;
+};
+
+/* bump-pointer allocator for the objects of one message */
+typedef struct arena {
+  struct arena_histogram *sizes;
+  void *chunks;
+  unsigned int nchunks;
+  unsigned char *next;
+  size_t left;
+  size_t used;
+} arena;
+
 /* verbosity global */
 extern int8_t verbose_level;
 
-/* uv loop global */
-extern uv_loop_t loop;
+/* uv loop of the calling thread, every shard runs its own */
+extern __thread uv_loop_t loop;
 
 /* address parsing helper inline functions */
 /** Helper: given a hex digit, return its value, or -1 if it isn't hex. */
@@ -401,6 +465,27 @@ define UNUSED(x) x
     pointer = NULL;                             \
   } while (0)
 
+#define SLAB_INIT(name, type) {name, sizeof(type), NULL, NULL, {0, 0, 0, 0, 0, 0}}
+
+/*
+ * Hot objects are taken from a slab. With BOX_NO_SLAB defined (DISABLE_SLAB
+ * and the sanitizer builds) they are plain heap objects, so use after free
+ * and leaks can be found per object.
+ */
+#ifdef BOX_NO_SLAB
+#define SLAB_MALLOC(slab, type) ((void)(slab), MALLOC(type))
+#define SLAB_FREE(slab, pointer) do {           \
+    (void)(slab);                               \
+    FREE(pointer);                              \
+  } while (0)
+#else
+#define SLAB_MALLOC(slab, type) ((type *)slab_alloc(slab))
+#define SLAB_FREE(slab, pointer) do {           \
+    slab_free(slab, pointer);                   \
+    pointer = NULL;                             \
+  } while (0)
+#endif
+
 #define LOG(...)                  \
   do {                            \
     fprintf(stdout, __VA_ARGS__); \
@@ -458,13 +543,93 @@ define UNUSED(x) x
 /* Functions */
 void *reallocarray(void *optr, size_t nmemb, size_t size);
 
+/**
+ * Take an object from `sl`, a new chunk of objects is allocated if its
+ * freelist is empty. Use SLAB_MALLOC() instead of calling this directly.
+ *
+ * @return the object or NULL if out of memory
+ */
+void *slab_alloc(slab *sl);
+
+/**
+ * Return an object allocated by slab_alloc() to the freelist of `sl`.
+ */
+void slab_free(slab *sl, void *pointer);
+
+/**
+ * Make sure at least `count` objects are free in `sl`, e.g. before a burst
+ * of connections.
+ *
+ * @return 0 on success, -1 if out of memory
+ */
+int slab_prewarm(slab *sl, size_t count);
+
+/**
+ * Free all chunks of `sl`. No object of `sl` may be in use anymore.
+ */
+void slab_destroy(slab *sl);
+void slab_log_stats(slab *sl);
+
+/**
+ * Create an arena. Its first chunk is as large as most arenas recorded in
+ * `sizes` needed, `sizes` may be NULL.
+ *
+ * @return the arena or NULL if out of memory
+ */
+arena *arena_new(struct arena_histogram *sizes);
+
+/**
+ * Take `size` bytes from `ar`, aligned for any type. A new chunk is
+ * allocated if the current one is full.
+ *
+ * @return the memory or NULL if out of memory
+ */
+void *arena_alloc(arena *ar, size_t size);
+void *arena_calloc(arena *ar, size_t nmemb, size_t size);
+
+/**
+ * Free `ar` with all memory taken from it and record its size in the
+ * histogram it was created with.
+ */
+void arena_free(arena *ar);
+
 string cstring_to_string(char *str);
 string cstring_copy_string(const char *str);
+string string_copy(string str);
 void free_string(string str);
 void sbmemzero(void * const pnt, const size_t len);
 
 int64_t randommod(long long n);
 
+/**
+ * Read `xlen` bytes straight from the kernel, with getrandom() or from
+ * /dev/urandom. randombytes() is much cheaper, this only seeds it.
+ */
+void devurandom_read(unsigned char *x, unsigned long long xlen);
+
+/**
+ * Select the fastest Salsa20 and Poly1305 implementations the cpu supports
+ * for the crypto_box functions of tweetnacl. tweetnacl's reference code
+ * stays in use where no optimized implementation is available.
+ */
+void secretbox_init(void);
+
+/**
+ * @return the name of the selected Salsa20 implementation
+ */
+const char *secretbox_implementation(void);
+
+/**
+ * Select the 64 bit Curve25519 implementation for the crypto_box functions
+ * of tweetnacl, if the compiler provides 128 bit products.
+ */
+void curve25519_init(void);
+
+/**
+ * @return the name of the selected Curve25519 implementation
+ */
+const char *curve25519_implementation(void);
+
 /**
  * The optparser parses the command line arguments. In case of an error,
  * it terminates the program (e.g. with exit(1)).
@@ -487,6 +652,11 @@ int options_init_from_boxrc(void);
 options * options_get(void);
 void options_free(options *options);
 
+/**
+ * @return the PluginWeight configured for `pluginkey`, 1 if there is none
+ */
+unsigned int options_plugin_weight(const char *pluginkey);
+
 /** If <b>key</b> is a configuration option, return the corresponding const
  * configvar.  Otherwise, if <b>key</b> is a non-standard abbreviation,
  * warn, and return the corresponding const configvar.  Otherwise return
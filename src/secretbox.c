@@ -0,0 +1,547 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Optimized Salsa20 and Poly1305 for the crypto_box functions of tweetnacl.
+ * tweetnacl computes one byte at a time, which bounds the throughput of
+ * every tunnel. The Salsa20 implementations compute 4 (SSE2) or 8 (AVX2)
+ * blocks in parallel, one state word of all blocks per vector register.
+ * Poly1305 uses 44 bit limbs and 128 bit products (poly1305-donna).
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "sb-common.h"
+#include "tweetnacl.h"
+#include "secretbox.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define SECRETBOX_X86
+#include <immintrin.h>
+#endif
+
+#define ADD32(a, b) ((uint32_t)((a) + (b)))
+#define XOR32(a, b) ((a) ^ (b))
+#define ROTL32(v, n) ((uint32_t)(((v) << (n)) | ((v) >> (32 - (n)))))
+
+#define QUARTERROUND(a, b, c, d, ADD, XOR, ROTL)                             \
+  do {                                                                       \
+    b = XOR(b, ROTL(ADD(a, d), 7));                                          \
+    c = XOR(c, ROTL(ADD(b, a), 9));                                          \
+    d = XOR(d, ROTL(ADD(c, b), 13));                                         \
+    a = XOR(a, ROTL(ADD(d, c), 18));                                         \
+  } while (0)
+
+/* a column round followed by a row round */
+#define DOUBLEROUND(x, ADD, XOR, ROTL)                                       \
+  do {                                                                       \
+    QUARTERROUND(x[0], x[4], x[8], x[12], ADD, XOR, ROTL);                   \
+    QUARTERROUND(x[5], x[9], x[13], x[1], ADD, XOR, ROTL);                   \
+    QUARTERROUND(x[10], x[14], x[2], x[6], ADD, XOR, ROTL);                  \
+    QUARTERROUND(x[15], x[3], x[7], x[11], ADD, XOR, ROTL);                  \
+    QUARTERROUND(x[0], x[1], x[2], x[3], ADD, XOR, ROTL);                    \
+    QUARTERROUND(x[5], x[6], x[7], x[4], ADD, XOR, ROTL);                    \
+    QUARTERROUND(x[10], x[11], x[8], x[9], ADD, XOR, ROTL);                  \
+    QUARTERROUND(x[15], x[12], x[13], x[14], ADD, XOR, ROTL);                \
+  } while (0)
+
+static const char *implementation = "tweetnacl";
+
+static uint32_t load32(const unsigned char *x)
+{
+  return (uint32_t)x[0] | (uint32_t)x[1] << 8 | (uint32_t)x[2] << 16 |
+      (uint32_t)x[3] << 24;
+}
+
+static uint64_t load64(const unsigned char *x)
+{
+  return (uint64_t)load32(x) | (uint64_t)load32(x + 4) << 32;
+}
+
+static void store32(unsigned char *x, uint32_t u)
+{
+  x[0] = (unsigned char)u;
+  x[1] = (unsigned char)(u >> 8);
+  x[2] = (unsigned char)(u >> 16);
+  x[3] = (unsigned char)(u >> 24);
+}
+
+static void store64(unsigned char *x, uint64_t u)
+{
+  store32(x, (uint32_t)u);
+  store32(x + 4, (uint32_t)(u >> 32));
+}
+
+static void salsa20_setup(uint32_t state[16], const unsigned char *n,
+    const unsigned char *k)
+{
+  /* "expand 32-byte k" */
+  state[0] = 0x61707865;
+  state[5] = 0x3320646e;
+  state[10] = 0x79622d32;
+  state[15] = 0x6b206574;
+
+  for (int i = 0; i < 4; i++) {
+    state[1 + i] = load32(k + 4 * i);
+    state[11 + i] = load32(k + 16 + 4 * i);
+  }
+
+  state[6] = load32(n);
+  state[7] = load32(n + 4);
+  state[8] = 0;
+  state[9] = 0;
+}
+
+static void salsa20_counter_add(uint32_t state[16], uint64_t blocks)
+{
+  uint64_t ctr = ((uint64_t)state[9] << 32 | state[8]) + blocks;
+
+  state[8] = (uint32_t)ctr;
+  state[9] = (uint32_t)(ctr >> 32);
+}
+
+/* one block at a time, used for the blocks the vector code leaves over */
+static int salsa20_xor_blocks(unsigned char *c, const unsigned char *m,
+    unsigned long long b, uint32_t state[16])
+{
+  uint32_t x[16];
+  unsigned char block[64];
+  uint64_t u;
+  int i;
+
+  while (b) {
+    memcpy(x, state, sizeof x);
+
+    for (i = 0; i < 10; i++)
+      DOUBLEROUND(x, ADD32, XOR32, ROTL32);
+
+    for (i = 0; i < 16; i++)
+      store32(block + 4 * i, x[i] + state[i]);
+
+    if (b < 64)
+      break;
+
+    for (i = 0; i < 64; i += 8) {
+      u = load64(block + i);
+      store64(c + i, m ? u ^ load64(m + i) : u);
+    }
+
+    salsa20_counter_add(state, 1);
+    b -= 64;
+    c += 64;
+    if (m)
+      m += 64;
+  }
+
+  for (i = 0; (unsigned long long)i < b; i++)
+    c[i] = (unsigned char)((m ? m[i] : 0) ^ block[i]);
+
+  sbmemzero(x, sizeof x);
+  sbmemzero(block, sizeof block);
+
+  return 0;
+}
+
+STATIC int salsa20_xor_portable(unsigned char *c, const unsigned char *m,
+    unsigned long long b, const unsigned char *n, const unsigned char *k)
+{
+  uint32_t state[16];
+
+  if (!b)
+    return 0;
+
+  salsa20_setup(state, n, k);
+  salsa20_xor_blocks(c, m, b, state);
+  sbmemzero(state, sizeof state);
+
+  return 0;
+}
+
+#ifdef SECRETBOX_X86
+
+#define ROTL_SSE2(v, n)                                                      \
+  _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+
+#define ROTL_AVX2(v, n)                                                      \
+  _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+
+/* writes the 16 bytes `v` xor `m` (or just `v` for a NULL `m`) to `c` */
+#define XORSTORE128(c, m, off, v)                                            \
+  _mm_storeu_si128((__m128i *)((c) + (off)), (m) ?                           \
+      _mm_xor_si128(v, _mm_loadu_si128((const __m128i *)((m) + (off)))) : (v))
+
+__attribute__((target("sse2")))
+static void salsa20_xor_sse2_blocks(unsigned char *c, const unsigned char *m,
+    unsigned long long b, uint32_t state[16])
+{
+  uint64_t ctr;
+  __m128i x[16], in[16];
+  __m128i t0, t1, t2, t3;
+  int i;
+
+  for (i = 0; i < 16; i++)
+    in[i] = _mm_set1_epi32((int)state[i]);
+
+  while (b >= 256) {
+    /* lane j computes block ctr + j */
+    ctr = (uint64_t)state[9] << 32 | state[8];
+    in[8] = _mm_set_epi32((int)(uint32_t)(ctr + 3), (int)(uint32_t)(ctr + 2),
+        (int)(uint32_t)(ctr + 1), (int)(uint32_t)ctr);
+    in[9] = _mm_set_epi32((int)(uint32_t)((ctr + 3) >> 32),
+        (int)(uint32_t)((ctr + 2) >> 32), (int)(uint32_t)((ctr + 1) >> 32),
+        (int)(uint32_t)(ctr >> 32));
+
+    memcpy(x, in, sizeof x);
+
+    for (i = 0; i < 10; i++)
+      DOUBLEROUND(x, _mm_add_epi32, _mm_xor_si128, ROTL_SSE2);
+
+    /* transpose words i..i+3 of the 4 blocks and write them out */
+    for (i = 0; i < 16; i += 4) {
+      x[i] = _mm_add_epi32(x[i], in[i]);
+      x[i + 1] = _mm_add_epi32(x[i + 1], in[i + 1]);
+      x[i + 2] = _mm_add_epi32(x[i + 2], in[i + 2]);
+      x[i + 3] = _mm_add_epi32(x[i + 3], in[i + 3]);
+
+      t0 = _mm_unpacklo_epi32(x[i], x[i + 1]);
+      t1 = _mm_unpacklo_epi32(x[i + 2], x[i + 3]);
+      t2 = _mm_unpackhi_epi32(x[i], x[i + 1]);
+      t3 = _mm_unpackhi_epi32(x[i + 2], x[i + 3]);
+
+      XORSTORE128(c, m, 4 * i, _mm_unpacklo_epi64(t0, t1));
+      XORSTORE128(c, m, 64 + 4 * i, _mm_unpackhi_epi64(t0, t1));
+      XORSTORE128(c, m, 128 + 4 * i, _mm_unpacklo_epi64(t2, t3));
+      XORSTORE128(c, m, 192 + 4 * i, _mm_unpackhi_epi64(t2, t3));
+    }
+
+    salsa20_counter_add(state, 4);
+    b -= 256;
+    c += 256;
+    if (m)
+      m += 256;
+  }
+
+  salsa20_xor_blocks(c, m, b, state);
+
+  sbmemzero(x, sizeof x);
+  sbmemzero(in, sizeof in);
+}
+
+STATIC int salsa20_xor_sse2(unsigned char *c, const unsigned char *m,
+    unsigned long long b, const unsigned char *n, const unsigned char *k)
+{
+  uint32_t state[16];
+
+  if (!b)
+    return 0;
+
+  salsa20_setup(state, n, k);
+  salsa20_xor_sse2_blocks(c, m, b, state);
+  sbmemzero(state, sizeof state);
+
+  return 0;
+}
+
+__attribute__((target("avx2")))
+STATIC int salsa20_xor_avx2(unsigned char *c, const unsigned char *m,
+    unsigned long long b, const unsigned char *n, const unsigned char *k)
+{
+  uint32_t state[16];
+  uint64_t ctr;
+  __m256i x[16], in[16];
+  __m256i t0, t1, t2, t3, u[4];
+  int i, j;
+
+  if (!b)
+    return 0;
+
+  salsa20_setup(state, n, k);
+
+  for (i = 0; i < 16; i++)
+    in[i] = _mm256_set1_epi32((int)state[i]);
+
+  while (b >= 512) {
+    /* lane j computes block ctr + j */
+    ctr = (uint64_t)state[9] << 32 | state[8];
+    in[8] = _mm256_set_epi32(
+        (int)(uint32_t)(ctr + 7), (int)(uint32_t)(ctr + 6),
+        (int)(uint32_t)(ctr + 5), (int)(uint32_t)(ctr + 4),
+        (int)(uint32_t)(ctr + 3), (int)(uint32_t)(ctr + 2),
+        (int)(uint32_t)(ctr + 1), (int)(uint32_t)ctr);
+    in[9] = _mm256_set_epi32(
+        (int)(uint32_t)((ctr + 7) >> 32), (int)(uint32_t)((ctr + 6) >> 32),
+        (int)(uint32_t)((ctr + 5) >> 32), (int)(uint32_t)((ctr + 4) >> 32),
+        (int)(uint32_t)((ctr + 3) >> 32), (int)(uint32_t)((ctr + 2) >> 32),
+        (int)(uint32_t)((ctr + 1) >> 32), (int)(uint32_t)(ctr >> 32));
+
+    memcpy(x, in, sizeof x);
+
+    for (i = 0; i < 10; i++)
+      DOUBLEROUND(x, _mm256_add_epi32, _mm256_xor_si256, ROTL_AVX2);
+
+    /*
+     * transpose words i..i+3 within each 128 bit lane, the low lane holds
+     * blocks 0-3 and the high lane blocks 4-7
+     */
+    for (i = 0; i < 16; i += 4) {
+      x[i] = _mm256_add_epi32(x[i], in[i]);
+      x[i + 1] = _mm256_add_epi32(x[i + 1], in[i + 1]);
+      x[i + 2] = _mm256_add_epi32(x[i + 2], in[i + 2]);
+      x[i + 3] = _mm256_add_epi32(x[i + 3], in[i + 3]);
+
+      t0 = _mm256_unpacklo_epi32(x[i], x[i + 1]);
+      t1 = _mm256_unpacklo_epi32(x[i + 2], x[i + 3]);
+      t2 = _mm256_unpackhi_epi32(x[i], x[i + 1]);
+      t3 = _mm256_unpackhi_epi32(x[i + 2], x[i + 3]);
+
+      u[0] = _mm256_unpacklo_epi64(t0, t1);
+      u[1] = _mm256_unpackhi_epi64(t0, t1);
+      u[2] = _mm256_unpacklo_epi64(t2, t3);
+      u[3] = _mm256_unpackhi_epi64(t2, t3);
+
+      for (j = 0; j < 4; j++) {
+        XORSTORE128(c, m, 64 * j + 4 * i, _mm256_castsi256_si128(u[j]));
+        XORSTORE128(c, m, 64 * (j + 4) + 4 * i,
+            _mm256_extracti128_si256(u[j], 1));
+      }
+    }
+
+    salsa20_counter_add(state, 8);
+    b -= 512;
+    c += 512;
+    if (m)
+      m += 512;
+  }
+
+  _mm256_zeroupper();
+
+  /* the leftover is still worth four blocks at a time */
+  salsa20_xor_sse2_blocks(c, m, b, state);
+
+  sbmemzero(state, sizeof state);
+  sbmemzero(x, sizeof x);
+  sbmemzero(in, sizeof in);
+
+  return 0;
+}
+
+STATIC bool cpu_supports_sse2(void)
+{
+  __builtin_cpu_init();
+  return (__builtin_cpu_supports("sse2") != 0);
+}
+
+STATIC bool cpu_supports_avx2(void)
+{
+  __builtin_cpu_init();
+  return (__builtin_cpu_supports("avx2") != 0);
+}
+
+#else
+
+STATIC int salsa20_xor_sse2(unsigned char *c, const unsigned char *m,
+    unsigned long long b, const unsigned char *n, const unsigned char *k)
+{
+  return salsa20_xor_portable(c, m, b, n, k);
+}
+
+STATIC int salsa20_xor_avx2(unsigned char *c, const unsigned char *m,
+    unsigned long long b, const unsigned char *n, const unsigned char *k)
+{
+  return salsa20_xor_portable(c, m, b, n, k);
+}
+
+STATIC bool cpu_supports_sse2(void)
+{
+  return false;
+}
+
+STATIC bool cpu_supports_avx2(void)
+{
+  return false;
+}
+
+#endif /* SECRETBOX_X86 */
+
+#ifdef __SIZEOF_INT128__
+
+__extension__ typedef unsigned __int128 uint128_t;
+
+#define MASK44 0xfffffffffffULL
+#define MASK42 0x3ffffffffffULL
+
+STATIC int poly1305_donna(unsigned char *out, const unsigned char *m,
+    unsigned long long n, const unsigned char *k)
+{
+  uint64_t r0, r1, r2, s1, s2;
+  uint64_t h0 = 0, h1 = 0, h2 = 0;
+  uint64_t g0, g1, g2;
+  uint64_t t0, t1, c, hibit;
+  uint128_t d0, d1, d2;
+  unsigned char block[16];
+  unsigned long long i;
+
+  /* r &= 0xffffffc0ffffffc0ffffffc0fffffff */
+  t0 = load64(k);
+  t1 = load64(k + 8);
+  r0 = t0 & 0xffc0fffffffULL;
+  r1 = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+  r2 = (t1 >> 24) & 0x00ffffffc0fULL;
+
+  s1 = r1 * (5 << 2);
+  s2 = r2 * (5 << 2);
+
+  while (n) {
+    if (n >= 16) {
+      t0 = load64(m);
+      t1 = load64(m + 8);
+      hibit = 1ULL << 40;
+      m += 16;
+      n -= 16;
+    } else {
+      /* the last partial block is padded with a single 1 byte */
+      for (i = 0; i < n; i++)
+        block[i] = m[i];
+      block[i++] = 1;
+      for (; i < 16; i++)
+        block[i] = 0;
+
+      t0 = load64(block);
+      t1 = load64(block + 8);
+      hibit = 0;
+      n = 0;
+    }
+
+    /* h += m */
+    h0 += t0 & MASK44;
+    h1 += ((t0 >> 44) | (t1 << 20)) & MASK44;
+    h2 += ((t1 >> 24) & MASK42) | hibit;
+
+    /* h *= r */
+    d0 = (uint128_t)h0 * r0 + (uint128_t)h1 * s2 + (uint128_t)h2 * s1;
+    d1 = (uint128_t)h0 * r1 + (uint128_t)h1 * r0 + (uint128_t)h2 * s2;
+    d2 = (uint128_t)h0 * r2 + (uint128_t)h1 * r1 + (uint128_t)h2 * r0;
+
+    /* (partial) h %= p */
+    c = (uint64_t)(d0 >> 44);
+    h0 = (uint64_t)d0 & MASK44;
+    d1 += c;
+    c = (uint64_t)(d1 >> 44);
+    h1 = (uint64_t)d1 & MASK44;
+    d2 += c;
+    c = (uint64_t)(d2 >> 42);
+    h2 = (uint64_t)d2 & MASK42;
+    h0 += c * 5;
+    c = h0 >> 44;
+    h0 &= MASK44;
+    h1 += c;
+  }
+
+  /* fully carry h */
+  c = h1 >> 44;
+  h1 &= MASK44;
+  h2 += c;
+  c = h2 >> 42;
+  h2 &= MASK42;
+  h0 += c * 5;
+  c = h0 >> 44;
+  h0 &= MASK44;
+  h1 += c;
+  c = h1 >> 44;
+  h1 &= MASK44;
+  h2 += c;
+  c = h2 >> 42;
+  h2 &= MASK42;
+  h0 += c * 5;
+  c = h0 >> 44;
+  h0 &= MASK44;
+  h1 += c;
+
+  /* g = h + -p */
+  g0 = h0 + 5;
+  c = g0 >> 44;
+  g0 &= MASK44;
+  g1 = h1 + c;
+  c = g1 >> 44;
+  g1 &= MASK44;
+  g2 = h2 + c - (1ULL << 42);
+
+  /* select h if h < p, or h + -p if h >= p, in constant time */
+  c = (g2 >> 63) - 1;
+  g0 &= c;
+  g1 &= c;
+  g2 &= c;
+  c = ~c;
+  h0 = (h0 & c) | g0;
+  h1 = (h1 & c) | g1;
+  h2 = (h2 & c) | g2;
+
+  /* h = h + s */
+  t0 = load64(k + 16);
+  t1 = load64(k + 24);
+  h0 += t0 & MASK44;
+  c = h0 >> 44;
+  h0 &= MASK44;
+  h1 += (((t0 >> 44) | (t1 << 20)) & MASK44) + c;
+  c = h1 >> 44;
+  h1 &= MASK44;
+  h2 += ((t1 >> 24) & MASK42) + c;
+  h2 &= MASK42;
+
+  /* out = h % 2^128 */
+  store64(out, h0 | (h1 << 44));
+  store64(out + 8, (h1 >> 20) | (h2 << 24));
+
+  sbmemzero(block, sizeof block);
+
+  return 0;
+}
+
+#else
+
+STATIC int poly1305_donna(unsigned char *out, const unsigned char *m,
+    unsigned long long n, const unsigned char *k)
+{
+  return crypto_onetimeauth_ref(out, m, n, k);
+}
+
+#endif /* __SIZEOF_INT128__ */
+
+void secretbox_init(void)
+{
+  if (cpu_supports_avx2()) {
+    crypto_stream_salsa20_xor_impl = salsa20_xor_avx2;
+    implementation = "avx2";
+  } else if (cpu_supports_sse2()) {
+    crypto_stream_salsa20_xor_impl = salsa20_xor_sse2;
+    implementation = "sse2";
+  } else {
+    crypto_stream_salsa20_xor_impl = salsa20_xor_portable;
+    implementation = "portable";
+  }
+
+  crypto_onetimeauth_impl = poly1305_donna;
+
+  LOG_VERBOSE(VERBOSE_LEVEL_0, "using %s salsa20 implementation\n",
+      implementation);
+}
+
+const char *secretbox_implementation(void)
+{
+  return (implementation);
+}
@@ -0,0 +1,30 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "sb-common.h"
+
+STATIC int salsa20_xor_portable(unsigned char *c, const unsigned char *m,
+    unsigned long long b, const unsigned char *n, const unsigned char *k);
+STATIC int salsa20_xor_sse2(unsigned char *c, const unsigned char *m,
+    unsigned long long b, const unsigned char *n, const unsigned char *k);
+STATIC int salsa20_xor_avx2(unsigned char *c, const unsigned char *m,
+    unsigned long long b, const unsigned char *n, const unsigned char *k);
+STATIC int poly1305_donna(unsigned char *out, const unsigned char *m,
+    unsigned long long n, const unsigned char *k);
+STATIC bool cpu_supports_sse2(void);
+STATIC bool cpu_supports_avx2(void);
@@ -0,0 +1,149 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A slab hands out objects of one type from chunks allocated in bulk. Freed
+ * objects go to the freelist of the slab and are reused by the next
+ * allocation, chunks are kept until slab_destroy(). Slabs are meant to be
+ * thread-local: objects must be freed on the thread that allocated them.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "sb-common.h"
+#include "slab.h"
+
+/* chunks are never returned to malloc before slab_destroy() */
+struct slab_chunk {
+  struct slab_chunk *next;
+};
+
+/* a free object stores the link to the next free object in place */
+struct slab_object {
+  struct slab_object *next;
+};
+
+void *slab_alloc(slab *sl)
+{
+  struct slab_object *object;
+
+  if (PREDICT_UNLIKELY(!sl->freelist) &&
+      slab_grow(sl, MAX(SLAB_CHUNK_SIZE / slab_objsize(sl), 1)) != 0)
+    return (NULL);
+
+  object = sl->freelist;
+  sl->freelist = object->next;
+  sl->stats.available--;
+  sl->stats.allocs++;
+
+  if (++sl->stats.inuse > sl->stats.peak)
+    sl->stats.peak = sl->stats.inuse;
+
+  return (object);
+}
+
+
+void slab_free(slab *sl, void *pointer)
+{
+  struct slab_object *object = pointer;
+
+  if (!object)
+    return;
+
+  object->next = sl->freelist;
+  sl->freelist = object;
+  sl->stats.available++;
+  sl->stats.frees++;
+  sl->stats.inuse--;
+}
+
+
+int slab_prewarm(slab *sl, size_t count)
+{
+  if (sl->stats.available >= count)
+    return (0);
+
+  return (slab_grow(sl, count - sl->stats.available));
+}
+
+
+void slab_destroy(slab *sl)
+{
+  struct slab_chunk *chunk;
+
+  while (sl->chunks) {
+    chunk = sl->chunks;
+    sl->chunks = chunk->next;
+    free(chunk);
+  }
+
+  sl->freelist = NULL;
+  sl->stats.available = 0;
+  sl->stats.inuse = 0;
+  sl->stats.chunks = 0;
+}
+
+
+void slab_log_stats(slab *sl)
+{
+  LOG_VERBOSE(VERBOSE_LEVEL_1, "slab %s: %" PRIu64 " allocs, %" PRIu64
+      " in use, %" PRIu64 " peak, %" PRIu64 " free, %" PRIu64 " chunks\n",
+      sl->name, sl->stats.allocs, sl->stats.inuse, sl->stats.peak,
+      sl->stats.available, sl->stats.chunks);
+}
+
+
+STATIC size_t slab_objsize(slab *sl)
+{
+  return (SLAB_ROUNDUP(MAX(sl->size, sizeof(struct slab_object))));
+}
+
+
+/* adds a chunk of `count` objects to the freelist of `sl` */
+STATIC int slab_grow(slab *sl, size_t count)
+{
+  struct slab_chunk *chunk;
+  struct slab_object *object;
+  unsigned char *base;
+  size_t objsize = slab_objsize(sl);
+  size_t header = SLAB_ROUNDUP(sizeof(struct slab_chunk));
+
+  if (count > (SIZE_MAX - header) / objsize)
+    return (-1);
+
+  chunk = malloc(header + count * objsize);
+
+  if (!chunk)
+    return (-1);
+
+  chunk->next = sl->chunks;
+  sl->chunks = chunk;
+  sl->stats.chunks++;
+
+  /* thread the objects in address order, so they are handed out in order */
+  base = (unsigned char *)chunk + header;
+
+  for (size_t i = count; i > 0; i--) {
+    object = (struct slab_object *)(base + (i - 1) * objsize);
+    object->next = sl->freelist;
+    sl->freelist = object;
+  }
+
+  sl->stats.available += count;
+
+  return (0);
+}
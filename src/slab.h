@@ -0,0 +1,27 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "sb-common.h"
+
+/* objects are carved from chunks of about this size */
+#define SLAB_CHUNK_SIZE 0x10000
+#define SLAB_ALIGN 16
+#define SLAB_ROUNDUP(x) (((x) + SLAB_ALIGN - 1) & ~((size_t)SLAB_ALIGN - 1))
+
+STATIC size_t slab_objsize(slab *sl);
+STATIC int slab_grow(slab *sl, size_t count);
@@ -46,6 +46,28 @@ string cstring_copy_string(const char *str)
   return (string) {.str = ret, .length = length};
 }
 
+/*
+ * Copies `str.length` bytes of `str`, which may contain NUL bytes or lack a
+ * terminating one, into a new NUL-terminated string.
+ */
+string string_copy(string str)
+{
+  char *ret;
+
+  if (!str.str)
+    return (string) STRING_INIT;
+
+  ret = MALLOC_ARRAY(str.length + 1, char);
+
+  if (!ret)
+    return (string) STRING_INIT;
+
+  memcpy(ret, str.str, str.length);
+  ret[str.length] = '\0';
+
+  return (string) {.str = ret, .length = str.length};
+}
+
 void free_string(string str)
 {
   if (!str.str) {
@@ -133,7 +133,7 @@ int crypto_core_hsalsa20(u8 *out,const u8 *in,const u8 *k,const u8 *c)
 
 static const u8 sigma[16] = "expand 32-byte k";
 
-int crypto_stream_salsa20_xor(u8 *c,const u8 *m,u64 b,const u8 *n,const u8 *k)
+int crypto_stream_salsa20_xor_ref(u8 *c,const u8 *m,u64 b,const u8 *n,const u8 *k)
 {
   u8 z[16],x[64];
   u32 u,i;
@@ -160,6 +160,14 @@ int crypto_stream_salsa20_xor(u8 *c,const u8 *m,u64 b,const u8 *n,const u8 *k)
   return 0;
 }
 
+/* replaced by an optimized implementation in secretbox_init() */
+int (*crypto_stream_salsa20_xor_impl)(u8 *,const u8 *,u64,const u8 *,const u8 *) = crypto_stream_salsa20_xor_ref;
+
+int crypto_stream_salsa20_xor(u8 *c,const u8 *m,u64 b,const u8 *n,const u8 *k)
+{
+  return crypto_stream_salsa20_xor_impl(c,m,b,n,k);
+}
+
 int crypto_stream_salsa20(u8 *c,u64 d,const u8 *n,const u8 *k)
 {
   return crypto_stream_salsa20_xor(c,0,d,n,k);
@@ -193,7 +201,7 @@ static const u32 minusp[17] = {
   5, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 252
 } ;
 
-int crypto_onetimeauth(u8 *out,const u8 *m,u64 n,const u8 *k)
+int crypto_onetimeauth_ref(u8 *out,const u8 *m,u64 n,const u8 *k)
 {
   u32 s,i,j,u,x[17],r[17],h[17],c[17],g[17];
 
@@ -246,6 +254,14 @@ int crypto_onetimeauth(u8 *out,const u8 *m,u64 n,const u8 *k)
   return 0;
 }
 
+/* replaced by an optimized implementation in secretbox_init() */
+int (*crypto_onetimeauth_impl)(u8 *,const u8 *,u64,const u8 *) = crypto_onetimeauth_ref;
+
+int crypto_onetimeauth(u8 *out,const u8 *m,u64 n,const u8 *k)
+{
+  return crypto_onetimeauth_impl(out,m,n,k);
+}
+
 int crypto_onetimeauth_verify(const u8 *h,const u8 *m,u64 n,const u8 *k)
 {
   u8 x[16];
@@ -402,7 +418,7 @@ sv pow2523(gf o,const gf i)
   FOR(a,16) o[a]=c[a];
 }
 
-int crypto_scalarmult(u8 *q,const u8 *n,const u8 *p)
+int crypto_scalarmult_ref(u8 *q,const u8 *n,const u8 *p)
 {
   u8 z[32];
   i64 x[80],r,i;
@@ -453,6 +469,14 @@ int crypto_scalarmult(u8 *q,const u8 *n,const u8 *p)
   return 0;
 }
 
+/* replaced by an optimized implementation in curve25519_init() */
+int (*crypto_scalarmult_impl)(u8 *,const u8 *,const u8 *) = crypto_scalarmult_ref;
+
+int crypto_scalarmult(u8 *q,const u8 *n,const u8 *p)
+{
+  return crypto_scalarmult_impl(q,n,p);
+}
+
 int crypto_scalarmult_base(u8 *q,const u8 *n)
 {
   return crypto_scalarmult(q,n,_9);
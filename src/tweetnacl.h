@@ -148,6 +148,8 @@ extern int crypto_hash_sha256_tweet(unsigned char *,const unsigned char *,unsign
 #define crypto_onetimeauth_poly1305_tweet_BYTES 16
 #define crypto_onetimeauth_poly1305_tweet_KEYBYTES 32
 extern int crypto_onetimeauth_poly1305_tweet(unsigned char *,const unsigned char *,unsigned long long,const unsigned char *);
+extern int crypto_onetimeauth_ref(unsigned char *,const unsigned char *,unsigned long long,const unsigned char *);
+extern int (*crypto_onetimeauth_impl)(unsigned char *,const unsigned char *,unsigned long long,const unsigned char *);
 extern int crypto_onetimeauth_poly1305_tweet_verify(const unsigned char *,const unsigned char *,unsigned long long,const unsigned char *);
 #define crypto_onetimeauth_poly1305_tweet_VERSION "-"
 #define crypto_onetimeauth_poly1305 crypto_onetimeauth_poly1305_tweet
@@ -167,6 +169,8 @@ extern int crypto_onetimeauth_poly1305_tweet_verify(const unsigned char *,const
 #define crypto_scalarmult_curve25519_tweet_SCALARBYTES 32
 extern int crypto_scalarmult_curve25519_tweet(unsigned char *,const unsigned char *,const unsigned char *);
 extern int crypto_scalarmult_curve25519_tweet_base(unsigned char *,const unsigned char *);
+extern int crypto_scalarmult_ref(unsigned char *,const unsigned char *,const unsigned char *);
+extern int (*crypto_scalarmult_impl)(unsigned char *,const unsigned char *,const unsigned char *);
 #define crypto_scalarmult_curve25519_tweet_VERSION "-"
 #define crypto_scalarmult_curve25519 crypto_scalarmult_curve25519_tweet
 #define crypto_scalarmult_curve25519_base crypto_scalarmult_curve25519_tweet_base
@@ -244,6 +248,8 @@ extern int crypto_stream_xsalsa20_tweet_xor(unsigned char *,const unsigned char
 #define crypto_stream_salsa20_tweet_NONCEBYTES 8
 extern int crypto_stream_salsa20_tweet(unsigned char *,unsigned long long,const unsigned char *,const unsigned char *);
 extern int crypto_stream_salsa20_tweet_xor(unsigned char *,const unsigned char *,unsigned long long,const unsigned char *,const unsigned char *);
+extern int crypto_stream_salsa20_xor_ref(unsigned char *,const unsigned char *,unsigned long long,const unsigned char *,const unsigned char *);
+extern int (*crypto_stream_salsa20_xor_impl)(unsigned char *,const unsigned char *,unsigned long long,const unsigned char *,const unsigned char *);
 #define crypto_stream_salsa20_tweet_VERSION "-"
 #define crypto_stream_salsa20 crypto_stream_salsa20_tweet
 #define crypto_stream_salsa20_xor crypto_stream_salsa20_tweet_xor
@@ -177,7 +177,10 @@ void functional_crypto(UNUSED(void **state))
 
   memcpy(hellopacket + 112, allzeroboxed + 16, 80);
 
-  crypto_init();
+  /* crypto_init reads the offload threshold and the key pool size */
+  assert_int_equal(0, options_init_from_boxrc());
+  assert_int_equal(0, crypto_init());
+  options_free(options_get());
 
   /* positiv test */
   assert_int_equal(0, crypto_recv_hello_send_cookie(&cc, hellopacket, &write));
@@ -225,6 +228,9 @@ void functional_crypto(UNUSED(void **state))
 
   memcpy(initiatepacket + 112, initiatebox + 16, 144);
 
+  /* the cookie outlives one replacement of the minute key */
+  crypto_update_minutekey();
+
   /* without valid certificate */
   assert_int_not_equal(0, crypto_recv_initiate(&cc, initiatepacket));
 
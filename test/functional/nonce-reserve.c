@@ -0,0 +1,76 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "helper-unix.h"
+
+#define THREADS 4
+/* more than a range, so the background thread has to reserve another */
+#define RESERVATIONS 400000
+
+static uint64_t counters[THREADS][RESERVATIONS];
+
+static void reserve(void *arg)
+{
+  uint64_t *out = arg;
+
+  for (int i = 0; i < RESERVATIONS; i++)
+    if (nonce_reserve(&out[i]) == -1)
+      out[i] = UINT64_MAX;
+}
+
+static int compare(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+void functional_nonce_reserve(UNUSED(void **state))
+{
+  uv_thread_t threads[THREADS];
+  unsigned char data[8];
+  uint64_t *all = &counters[0][0];
+  uint64_t persisted;
+
+  assert_int_equal(0, nonce_init());
+
+  for (int i = 0; i < THREADS; i++)
+    assert_int_equal(0, uv_thread_create(&threads[i], reserve, counters[i]));
+
+  for (int i = 0; i < THREADS; i++)
+    assert_int_equal(0, uv_thread_join(&threads[i]));
+
+  /* every thread sees increasing counters */
+  for (int i = 0; i < THREADS; i++)
+    for (int j = 1; j < RESERVATIONS; j++)
+      assert_true(counters[i][j - 1] < counters[i][j]);
+
+  /* no counter is handed out twice and, as nobody else moved the persisted
+     counter, none is skipped when the next range is reserved */
+  qsort(all, THREADS * RESERVATIONS, sizeof(*all), compare);
+
+  for (int i = 1; i < THREADS * RESERVATIONS; i++)
+    assert_true(all[i - 1] + 1 == all[i]);
+
+  /* and all of them are covered by the persisted counter */
+  assert_int_equal(0, filesystem_load(".keys/noncecounter", data,
+      sizeof(data)));
+  persisted = uint64_unpack(data);
+  assert_true(all[THREADS * RESERVATIONS - 1] < persisted);
+}
@@ -95,8 +95,8 @@ int validate_run_request(const unsigned long data1,
    * sender of the rpc call, we need to push the callid on the cmocka test
    * stack. this allows verifying of it later on */
   uint64_t callid = meta.data.params.obj[1].data.uinteger;
-  will_return(__wrap_loop_wait_for_response, OBJECT_TYPE_UINT);
-  will_return(__wrap_loop_wait_for_response, callid);
+  will_return(__wrap_loop_register_call, OBJECT_TYPE_UINT);
+  will_return(__wrap_loop_register_call, callid);
   expect_value(validate_run_response, response.data.params.obj[0].data.uinteger, callid);
   p->callid = callid;
 
@@ -207,8 +207,8 @@ int validate_result_request(const unsigned long data1,
    * stack. this allows verifying of it later on */
   uint64_t callid = meta.data.params.obj[0].data.uinteger;
 
-  will_return(__wrap_loop_wait_for_response, OBJECT_TYPE_UINT);
-  will_return(__wrap_loop_wait_for_response, callid);
+  will_return(__wrap_loop_register_call, OBJECT_TYPE_UINT);
+  will_return(__wrap_loop_register_call, callid);
   expect_value(validate_result_response, response.data.params.obj[0].data.uinteger, callid);
 
   free_params(params);
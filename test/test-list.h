@@ -30,9 +30,14 @@ void unit_pack_bool(void **state);
 void unit_unpack_string(void **state);
 void unit_unpack_uint(void **state);
 void unit_unpack_array(void **state);
+void unit_unpack_params_view(void **state);
+void unit_unpack_raw(void **state);
+void unit_pack_params_size(void **state);
 void unit_dispatch_table_get(void **state);
 void unit_event_queue_put(void **state);
 void unit_event_queue_get(void **state);
+void unit_event_queue_benchmark(void **state);
+void unit_event_queue_weight(void **state);
 void unit_regression_issue_60(void **state);
 void unit_message_deserialize_request(void **state);
 void unit_message_deserialize_response(void **state);
@@ -42,6 +47,17 @@ void unit_message_serialize_response(void **state);
 void unit_message_serialize_error_response(void **state);
 void unit_message_is_request(void **state);
 void unit_message_is_response(void **state);
+void unit_connection_pending_calls(void **state);
+void unit_inputstream_view(void **state);
+void unit_secretbox_equivalence(void **state);
+void unit_curve25519_known_answer(void **state);
+void unit_curve25519_benchmark(void **state);
+void unit_keypool_pop(void **state);
+void unit_keycache_lru(void **state);
+void unit_random_drbg(void **state);
+void unit_random_benchmark(void **state);
+void unit_slab_alloc(void **state);
+void unit_arena_alloc(void **state);
 
 void functional_client_connect(void **state);
 void functional_db_connect(void **state);
@@ -56,6 +72,7 @@ void functional_dispatch_handle_register(void **state);
 void functional_dispatch_handle_run(void **state);
 void functional_dispatch_handle_result(void **state);
 void functional_crypto(void **state);
+void functional_nonce_reserve(void **state);
 void functional_confparse(void **state);
 void functional_db_whitelist(void **state);
 
@@ -71,7 +88,13 @@ const struct CMUnitTest tests[] = {
   cmocka_unit_test(unit_pack_bool),
   cmocka_unit_test(unit_pack_array),
   cmocka_unit_test(unit_regression_issue_60),
+  cmocka_unit_test(unit_unpack_params_view),
+  cmocka_unit_test(unit_unpack_raw),
+  cmocka_unit_test(unit_pack_params_size),
   cmocka_unit_test(unit_event_queue_put),
+  cmocka_unit_test(unit_event_queue_get),
+  cmocka_unit_test(unit_event_queue_benchmark),
+  cmocka_unit_test(unit_event_queue_weight),
   cmocka_unit_test(unit_message_deserialize_request),
   cmocka_unit_test(unit_message_deserialize_response),
   cmocka_unit_test(unit_message_deserialize_error_response),
@@ -80,6 +103,17 @@ const struct CMUnitTest tests[] = {
   cmocka_unit_test(unit_message_serialize_error_response),
   cmocka_unit_test(unit_message_is_request),
   cmocka_unit_test(unit_message_is_response),
+  cmocka_unit_test(unit_connection_pending_calls),
+  cmocka_unit_test(unit_inputstream_view),
+  cmocka_unit_test(unit_secretbox_equivalence),
+  cmocka_unit_test(unit_curve25519_known_answer),
+  cmocka_unit_test(unit_curve25519_benchmark),
+  cmocka_unit_test(unit_keypool_pop),
+  cmocka_unit_test(unit_keycache_lru),
+  cmocka_unit_test(unit_random_drbg),
+  cmocka_unit_test(unit_random_benchmark),
+  cmocka_unit_test(unit_slab_alloc),
+  cmocka_unit_test(unit_arena_alloc),
   cmocka_unit_test(functional_db_connect),
   cmocka_unit_test(functional_db_plugin_add),
   cmocka_unit_test(functional_db_pluginkey_verify),
@@ -92,6 +126,7 @@ const struct CMUnitTest tests[] = {
   cmocka_unit_test(functional_dispatch_handle_run),
   cmocka_unit_test(functional_dispatch_handle_result),
   cmocka_unit_test(functional_crypto),
+  cmocka_unit_test(functional_nonce_reserve),
   cmocka_unit_test(functional_confparse),
   cmocka_unit_test(functional_db_whitelist),
 };
@@ -0,0 +1,78 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+
+#include "sb-common.h"
+#include "arena.h"
+#include "helper-unix.h"
+
+void unit_arena_alloc(UNUSED(void **state))
+{
+  struct arena_histogram sizes = {{0}, 0};
+  unsigned char *p, *q;
+  arena *ar;
+
+  /* allocations are aligned and don't overlap */
+  ar = arena_new(NULL);
+  assert_non_null(ar);
+  assert_int_equal(1, ar->nchunks);
+
+  p = arena_alloc(ar, 3);
+  q = arena_alloc(ar, 5);
+  assert_non_null(p);
+  assert_non_null(q);
+  assert_int_equal(0, (uintptr_t)p % ARENA_ALIGN);
+  assert_int_equal(0, (uintptr_t)q % ARENA_ALIGN);
+  assert_true(q >= p + 3);
+
+  /* a full chunk is followed by a larger one */
+  p = arena_calloc(ar, ARENA_MIN_SIZE, 4);
+  assert_non_null(p);
+  assert_int_equal(0, p[ARENA_MIN_SIZE * 4 - 1]);
+  assert_int_equal(2, ar->nchunks);
+  assert_null(arena_calloc(ar, SIZE_MAX / 2, 4));
+  arena_free(ar);
+
+  /* the histogram is empty, the first chunk has the minimum size */
+  assert_int_equal(ARENA_MIN_SIZE, arena_histogram_size(&sizes));
+
+  /* most requests needed about 3 KB, the rest much more */
+  for (int i = 0; i < 95; i++) {
+    ar = arena_new(&sizes);
+    assert_non_null(arena_alloc(ar, 3000));
+    arena_free(ar);
+  }
+
+  for (int i = 0; i < 5; i++)
+    arena_histogram_add(&sizes, 1 << 20);
+
+  assert_int_equal(100, sizes.total);
+  assert_int_equal(4096, arena_histogram_size(&sizes));
+
+  /* so 3 KB fit into the first chunk of a new arena */
+  ar = arena_new(&sizes);
+  assert_non_null(arena_alloc(ar, 3000));
+  assert_int_equal(1, ar->nchunks);
+  arena_free(ar);
+
+  /* old sizes fade out */
+  for (int i = 0; i < ARENA_HISTOGRAM_WINDOW; i++)
+    arena_histogram_add(&sizes, 100);
+
+  assert_true(sizes.total < ARENA_HISTOGRAM_WINDOW);
+  assert_int_equal(ARENA_MIN_SIZE, arena_histogram_size(&sizes));
+}
@@ -0,0 +1,76 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "rpc/connection/connection.h"
+#include "helper-unix.h"
+
+void __real_loop_register_call(struct connection *con,
+    struct callinfo *cinfo);
+
+static uint32_t completed[3];
+static size_t ncompleted;
+
+static void pending_call_cb(struct callinfo *cinfo, UNUSED(void *data))
+{
+  completed[ncompleted++] = cinfo->msgid;
+}
+
+static struct callinfo *new_call(uint32_t msgid)
+{
+  struct callinfo *cinfo = CALLOC(1, struct callinfo);
+
+  assert_non_null(cinfo);
+  cinfo->msgid = msgid;
+  cinfo->cb = pending_call_cb;
+
+  return (cinfo);
+}
+
+void unit_connection_pending_calls(UNUSED(void **state))
+{
+  struct connection *con = CALLOC(1, struct connection);
+
+  assert_non_null(con);
+  ncompleted = 0;
+
+  __real_loop_register_call(con, new_call(1));
+  __real_loop_register_call(con, new_call(2));
+  __real_loop_register_call(con, new_call(3));
+  assert_int_equal(3, con->pendingcalls);
+
+  /* unknown msgid must not match any pending call */
+  assert_null(get_pending_call(con, 4));
+
+  /* responses are matched in any order */
+  loop_complete_call(con, get_pending_call(con, 2));
+  loop_complete_call(con, get_pending_call(con, 1));
+
+  assert_int_equal(2, ncompleted);
+  assert_int_equal(2, completed[0]);
+  assert_int_equal(1, completed[1]);
+  assert_int_equal(1, con->pendingcalls);
+  assert_null(get_pending_call(con, 1));
+  assert_null(get_pending_call(con, 2));
+  assert_non_null(get_pending_call(con, 3));
+
+  loop_complete_call(con, get_pending_call(con, 3));
+  assert_int_equal(0, con->pendingcalls);
+
+  hashmap_free(uint64_t, ptr_t)(con->calls);
+  FREE(con);
+}
@@ -0,0 +1,69 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "sb-common.h"
+#include "tweetnacl.h"
+#include "helper-unix.h"
+
+#define HANDSHAKES 64
+
+typedef int (*scalarmult)(unsigned char *q, const unsigned char *n,
+    const unsigned char *p);
+
+/*
+ * The server side of a tunnel handshake: a short-term keypair and three
+ * precomputed shared keys (crypto_recv_hello_send_cookie and
+ * crypto_recv_initiate).
+ */
+static double handshakes_per_second(scalarmult impl)
+{
+  unsigned char pk[32], sk[32], peer[32], k[32];
+  uint64_t start, elapsed;
+
+  crypto_scalarmult_impl = impl;
+  randombytes(peer, sizeof(peer));
+
+  start = uv_hrtime();
+
+  for (int i = 0; i < HANDSHAKES; i++) {
+    assert_int_equal(0, crypto_box_keypair(pk, sk));
+    assert_int_equal(0, crypto_box_beforenm(k, peer, sk));
+    assert_int_equal(0, crypto_box_beforenm(k, peer, sk));
+    assert_int_equal(0, crypto_box_beforenm(k, pk, sk));
+  }
+
+  elapsed = uv_hrtime() - start;
+
+  return (HANDSHAKES * 1e9 / (double)(elapsed ? elapsed : 1));
+}
+
+void unit_curve25519_benchmark(UNUSED(void **state))
+{
+  scalarmult selected;
+  double ref, fast;
+
+  curve25519_init();
+  selected = crypto_scalarmult_impl;
+
+  ref = handshakes_per_second(crypto_scalarmult_ref);
+  fast = handshakes_per_second(selected);
+
+  crypto_scalarmult_impl = selected;
+
+  LOG("curve25519: tweetnacl %.0f, %s %.0f handshakes/s\n", ref,
+      curve25519_implementation(), fast);
+}
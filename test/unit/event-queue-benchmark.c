@@ -0,0 +1,177 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "helper-unix.h"
+
+#define CHILDREN 64
+#define ROUNDS 20000
+
+/*
+ * The former event queue for comparison: every put allocates an entry for
+ * the child and a proxy entry for the root queue, every get frees them.
+ */
+struct legacy_entry;
+TAILQ_HEAD(legacy_queue_head, legacy_entry);
+
+struct legacy_queue {
+  struct legacy_queue_head head;
+  struct legacy_queue *root;
+};
+
+struct legacy_entry {
+  union {
+    struct legacy_queue *queue;
+    struct {
+      struct legacy_entry *root;
+      api_event event;
+    } entry;
+  } data;
+  TAILQ_ENTRY(legacy_entry) node;
+};
+
+static struct legacy_queue *legacy_new(struct legacy_queue *root)
+{
+  struct legacy_queue *queue = MALLOC(struct legacy_queue);
+
+  assert_non_null(queue);
+  queue->root = root;
+  TAILQ_INIT(&queue->head);
+
+  return (queue);
+}
+
+static void legacy_put(struct legacy_queue *queue, api_event event)
+{
+  struct legacy_entry *entry = MALLOC(struct legacy_entry);
+
+  entry->data.entry.event = event;
+  TAILQ_INSERT_TAIL(&queue->head, entry, node);
+
+  entry->data.entry.root = MALLOC(struct legacy_entry);
+  entry->data.entry.root->data.queue = queue;
+  TAILQ_INSERT_TAIL(&queue->root->head, entry->data.entry.root, node);
+}
+
+static api_event legacy_get_from_root(struct legacy_queue *root)
+{
+  struct legacy_entry *entry, *centry;
+  struct legacy_queue *cqueue;
+  api_event event;
+
+  entry = TAILQ_FIRST(&root->head);
+  TAILQ_REMOVE(&root->head, entry, node);
+  cqueue = entry->data.queue;
+  centry = TAILQ_FIRST(&cqueue->head);
+  TAILQ_REMOVE(&cqueue->head, centry, node);
+  FREE(entry);
+
+  event = centry->data.entry.event;
+  FREE(centry);
+
+  return (event);
+}
+
+static uint64_t sink;
+
+static void count_handler(connection_request_event_info *info)
+{
+  sink += info->request.msgid;
+}
+
+static double legacy_events_per_second(api_event event)
+{
+  struct legacy_queue *root, *children[CHILDREN];
+  uint64_t start, elapsed;
+  api_event next;
+
+  root = legacy_new(NULL);
+
+  for (int i = 0; i < CHILDREN; i++)
+    children[i] = legacy_new(root);
+
+  start = uv_hrtime();
+
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < CHILDREN; i++)
+      legacy_put(children[i], event);
+
+    while (!TAILQ_EMPTY(&root->head)) {
+      next = legacy_get_from_root(root);
+      next.handler(&next.info);
+    }
+  }
+
+  elapsed = uv_hrtime() - start;
+
+  for (int i = 0; i < CHILDREN; i++)
+    FREE(children[i]);
+
+  FREE(root);
+
+  return ((double)CHILDREN * ROUNDS * 1e9 / (double)(elapsed ? elapsed : 1));
+}
+
+static double events_per_second(api_event event)
+{
+  equeue *root, *children[CHILDREN];
+  uint64_t start, elapsed;
+
+  root = equeue_new(NULL);
+  assert_non_null(root);
+
+  for (int i = 0; i < CHILDREN; i++) {
+    children[i] = equeue_new(root);
+    assert_non_null(children[i]);
+  }
+
+  start = uv_hrtime();
+
+  for (int r = 0; r < ROUNDS; r++) {
+    for (int i = 0; i < CHILDREN; i++)
+      equeue_put(children[i], event);
+
+    equeue_run_events(root);
+  }
+
+  elapsed = uv_hrtime() - start;
+
+  for (int i = 0; i < CHILDREN; i++)
+    equeue_free(children[i]);
+
+  equeue_free(root);
+
+  return ((double)CHILDREN * ROUNDS * 1e9 / (double)(elapsed ? elapsed : 1));
+}
+
+void unit_event_queue_benchmark(UNUSED(void **state))
+{
+  api_event event;
+  double legacy, ring;
+
+  memset(&event, 0, sizeof(event));
+  event.handler = count_handler;
+  event.info.request.msgid = 1;
+
+  legacy = legacy_events_per_second(event);
+  ring = events_per_second(event);
+
+  assert_int_equal(2 * (uint64_t)CHILDREN * ROUNDS, sink);
+
+  LOG("event queue: tailq %.0f, ring %.0f events/s\n", legacy, ring);
+}
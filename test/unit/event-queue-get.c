@@ -18,21 +18,63 @@
 #include "rpc/sb-rpc.h"
 #include "helper-unix.h"
 
-equeue *equeue_root;
-equeue *equeue_child_one;
+static equeue *equeue_child_one;
+static equeue *equeue_child_two;
 static api_event events;
 
+static api_event tagged(uint32_t tag)
+{
+  api_event event = events;
+
+  event.info.request.msgid = tag;
+
+  return (event);
+}
+
 void unit_event_queue_get(UNUSED(void **state))
 {
   equeue_root = equeue_new(NULL);
   assert_non_null(equeue_root);
   equeue_child_one = equeue_new(equeue_root);
   assert_non_null(equeue_child_one);
+  equeue_child_two = equeue_new(equeue_root);
+  assert_non_null(equeue_child_two);
 
-  assert_int_not_equal(0, equeue_put(equeue_child_one, events));
-  assert_false(TAILQ_EMPTY(&equeue_root->head));
+  assert_int_equal(0, equeue_put(equeue_child_one, events));
+  assert_false(equeue_empty(equeue_root));
   equeue_get(equeue_child_one);
-  assert_true(TAILQ_EMPTY(&equeue_root->head));
+  assert_true(equeue_empty(equeue_root));
+
+  /* the ring of a child wraps around and refuses events once full */
+  for (uint32_t round = 0; round < 3; round++) {
+    for (uint32_t i = 0; i < EQUEUE_CAPACITY; i++)
+      assert_int_equal(0, equeue_put(equeue_child_one, tagged(i)));
+
+    assert_int_not_equal(0, equeue_put(equeue_child_one, tagged(0)));
+
+    for (uint32_t i = 0; i < EQUEUE_CAPACITY; i++)
+      assert_int_equal(i, equeue_get(equeue_child_one).info.request.msgid);
+
+    assert_true(equeue_empty(equeue_child_one));
+  }
+
+  /* the root serves ready children in turn */
+  assert_int_equal(0, equeue_put(equeue_child_one, tagged(1)));
+  assert_int_equal(0, equeue_put(equeue_child_one, tagged(2)));
+  assert_int_equal(0, equeue_put(equeue_child_two, tagged(10)));
+  assert_int_equal(0, equeue_put(equeue_child_two, tagged(20)));
+
+  assert_int_equal(1, equeue_get(equeue_root).info.request.msgid);
+  assert_int_equal(10, equeue_get(equeue_root).info.request.msgid);
+  assert_int_equal(2, equeue_get(equeue_root).info.request.msgid);
+  assert_int_equal(20, equeue_get(equeue_root).info.request.msgid);
+  assert_true(equeue_empty(equeue_root));
+  assert_null(equeue_get(equeue_root).handler);
+
+  /* a freed child leaves the ready list */
+  assert_int_equal(0, equeue_put(equeue_child_two, tagged(30)));
+  equeue_free(equeue_child_two);
+  assert_true(equeue_empty(equeue_root));
 
   equeue_free(equeue_root);
   equeue_free(equeue_child_one);
@@ -19,7 +19,6 @@
 #include "helper-unix.h"
 
 
-equeue *equeue_root;
 equeue *equeue_child_one;
 equeue *equeue_child_two;
 static api_event events;
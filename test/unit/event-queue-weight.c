@@ -0,0 +1,78 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "helper-unix.h"
+
+static uint32_t order[32];
+static size_t ran;
+
+static void record(connection_request_event_info *info)
+{
+  order[ran++] = info->request.msgid;
+}
+
+static void put_tagged(equeue *queue, uint32_t tag)
+{
+  api_event event;
+
+  memset(&event, 0, sizeof(event));
+  event.handler = record;
+  event.info.request.msgid = tag;
+  assert_int_equal(0, equeue_put(queue, event));
+}
+
+void unit_event_queue_weight(UNUSED(void **state))
+{
+  equeue *root, *bulk, *small;
+  const uint32_t expected[] = {1, 1, 1, 2, 1, 1, 1, 2, 1, 1};
+
+  root = equeue_new(NULL);
+  assert_non_null(root);
+  bulk = equeue_new(root);
+  assert_non_null(bulk);
+  small = equeue_new(root);
+  assert_non_null(small);
+
+  equeue_set_weight(bulk, 3);
+
+  for (int i = 0; i < EQUEUE_CAPACITY; i++)
+    put_tagged(bulk, 1);
+
+  put_tagged(small, 2);
+  put_tagged(small, 2);
+
+  /* the budget ends the first run within the second turn of bulk */
+  assert_int_equal(5, equeue_run_budget(root, 5));
+  assert_int_equal(5, ran);
+  assert_false(equeue_empty(root));
+
+  /* the rest of the turn is kept for the next run */
+  assert_int_equal(5, equeue_run_budget(root, 32));
+  assert_int_equal(10, ran);
+  assert_true(equeue_empty(root));
+  assert_memory_equal(expected, order, sizeof(expected));
+
+  /* the weight can't be 0 */
+  equeue_set_weight(small, 0);
+  assert_int_equal(1, small->weight);
+
+  equeue_free(bulk);
+  equeue_free(small);
+  equeue_free(root);
+}
@@ -0,0 +1,70 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "helper-unix.h"
+
+void unit_inputstream_view(UNUSED(void **state))
+{
+  struct inputstream_view view;
+  unsigned char buf[8];
+  unsigned char *first, *second;
+  inputstream *istream = inputstream_new(NULL, INPUTSTREAM_SEGMENT_SIZE * 4,
+      NULL);
+
+  assert_non_null(istream);
+  assert_int_equal(0, inputstream_get_view(istream, &view));
+
+  /* 4 pending bytes spanning two segments */
+  first = MALLOC_ARRAY(INPUTSTREAM_SEGMENT_SIZE, unsigned char);
+  second = MALLOC_ARRAY(INPUTSTREAM_SEGMENT_SIZE, unsigned char);
+  assert_non_null(first);
+  assert_non_null(second);
+  memcpy(first + INPUTSTREAM_SEGMENT_SIZE - 2, "ab", 2);
+  memcpy(second, "cd", 2);
+  kv_push(unsigned char *, istream->segments, first);
+  kv_push(unsigned char *, istream->segments, second);
+  istream->readpos = INPUTSTREAM_SEGMENT_SIZE - 2;
+  istream->writepos = 2;
+  istream->size = 4;
+
+  assert_int_equal(4, inputstream_get_view(istream, &view));
+  assert_ptr_equal(first + INPUTSTREAM_SEGMENT_SIZE - 2, view.data[0]);
+  assert_int_equal(2, view.len[0]);
+  assert_ptr_equal(second, view.data[1]);
+  assert_int_equal(2, view.len[1]);
+
+  /* reading across the segment border drops the drained segment */
+  assert_int_equal(3, inputstream_read(istream, buf, 3));
+  assert_memory_equal("abc", buf, 3);
+  assert_int_equal(1, kv_size(istream->segments));
+  assert_int_equal(1, istream->readpos);
+
+  assert_int_equal(1, inputstream_get_view(istream, &view));
+  assert_ptr_equal(second + 1, view.data[0]);
+  assert_int_equal(1, view.len[0]);
+  assert_int_equal(0, view.len[1]);
+
+  /* never reads more than pending, a drained stream keeps no segments */
+  assert_int_equal(1, inputstream_read(istream, buf, sizeof(buf)));
+  assert_int_equal('d', buf[0]);
+  assert_int_equal(0, inputstream_pending(istream));
+  assert_int_equal(0, kv_size(istream->segments));
+
+  kv_destroy(istream->segments);
+  FREE(istream);
+}
@@ -0,0 +1,74 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <unistd.h>
+
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "helper-unix.h"
+
+void unit_keycache_lru(UNUSED(void **state))
+{
+  unsigned char pk[3][32], key[3][32], out[32];
+
+  for (int i = 0; i < 3; i++) {
+    memset(pk[i], 'a' + i, sizeof(pk[i]));
+    memset(key[i], 'A' + i, sizeof(key[i]));
+  }
+
+  /* a disabled cache never hits */
+  assert_int_equal(0, keycache_init(0, 0));
+  keycache_put(pk[0], key[0]);
+  assert_int_equal(-1, keycache_get(out, pk[0]));
+
+  assert_int_equal(0, keycache_init(2, 0));
+
+  assert_int_equal(-1, keycache_get(out, pk[0]));
+  keycache_put(pk[0], key[0]);
+  keycache_put(pk[1], key[1]);
+  assert_int_equal(2, keycache_count());
+
+  assert_int_equal(0, keycache_get(out, pk[0]));
+  assert_memory_equal(key[0], out, 32);
+
+  /* pk[1] is the least recently used now */
+  keycache_put(pk[2], key[2]);
+  assert_int_equal(2, keycache_count());
+  assert_int_equal(-1, keycache_get(out, pk[1]));
+  assert_int_equal(0, keycache_get(out, pk[0]));
+  assert_memory_equal(key[0], out, 32);
+  assert_int_equal(0, keycache_get(out, pk[2]));
+  assert_memory_equal(key[2], out, 32);
+
+  /* replacing a key keeps a single entry */
+  keycache_put(pk[2], key[1]);
+  assert_int_equal(2, keycache_count());
+  assert_int_equal(0, keycache_get(out, pk[2]));
+  assert_memory_equal(key[1], out, 32);
+
+  keycache_free();
+
+  /* expired keys are dropped */
+  assert_int_equal(0, keycache_init(2, 10));
+  keycache_put(pk[0], key[0]);
+  assert_int_equal(0, keycache_get(out, pk[0]));
+  usleep(20000);
+  assert_int_equal(-1, keycache_get(out, pk[0]));
+  assert_int_equal(0, keycache_count());
+
+  keycache_free();
+}
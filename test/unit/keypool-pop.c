@@ -0,0 +1,65 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <unistd.h>
+
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "tweetnacl.h"
+#include "helper-unix.h"
+
+#define POOLSIZE 4
+
+static void assert_keypair(const unsigned char *pk, const unsigned char *sk)
+{
+  unsigned char expected[32];
+
+  assert_int_equal(0, crypto_scalarmult_base(expected, sk));
+  assert_memory_equal(expected, pk, 32);
+}
+
+void unit_keypool_pop(UNUSED(void **state))
+{
+  unsigned char pk[POOLSIZE + 1][32], sk[POOLSIZE + 1][32];
+
+  /* the pool is not running yet, keys are generated on demand */
+  assert_int_equal(0, keypool_available());
+  assert_int_equal(0, keypool_pop(pk[0], sk[0]));
+  assert_keypair(pk[0], sk[0]);
+
+  assert_int_equal(0, keypool_init(POOLSIZE));
+
+  for (int i = 0; i < 5000 && keypool_available() < POOLSIZE; i++)
+    usleep(1000);
+
+  assert_int_equal(POOLSIZE, keypool_available());
+
+  /* drain the pool and one more */
+  for (int i = 0; i <= POOLSIZE; i++) {
+    assert_int_equal(0, keypool_pop(pk[i], sk[i]));
+    assert_keypair(pk[i], sk[i]);
+
+    for (int j = 0; j < i; j++)
+      assert_memory_not_equal(sk[i], sk[j], 32);
+  }
+
+  /* it is refilled in the background */
+  for (int i = 0; i < 5000 && keypool_available() < POOLSIZE; i++)
+    usleep(1000);
+
+  assert_int_equal(POOLSIZE, keypool_available());
+}
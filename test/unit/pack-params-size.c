@@ -0,0 +1,123 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <msgpack.h>
+#include <string.h>
+
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "rpc/msgpack/sb-msgpack-rpc.h"
+#include "helper-unix.h"
+
+#define BIG_SIZE 70000
+
+void unit_pack_params_size(UNUSED(void **state))
+{
+  uint64_t uints[] = {0, 127, 128, 255, 256, 65535, 65536, 4294967295ULL,
+      4294967296ULL, UINT64_MAX};
+  int64_t ints[] = {-1, -32, -33, -128, -129, -32768, -32769, -2147483648LL,
+      -2147483649LL, INT64_MIN, 200};
+  size_t lengths[] = {0, 255, 256, 65535, 65536};
+  struct message_request request;
+  struct message_response response;
+  struct pack_buffer buffer;
+  msgpack_sbuffer sbuf;
+  msgpack_packer pk;
+  array params, nested;
+  char *big, small[4];
+
+  big = MALLOC_ARRAY(BIG_SIZE, char);
+  assert_non_null(big);
+  memset(big, 'x', BIG_SIZE);
+
+  /* [uints..., ints..., strings..., 1.5, nil, true, [17 x nil], raw] */
+  params.size = 10 + 11 + 5 + 5;
+  params.obj = CALLOC(params.size, struct message_object);
+  assert_non_null(params.obj);
+
+  nested.size = 17;
+  nested.obj = CALLOC(nested.size, struct message_object);
+  assert_non_null(nested.obj);
+
+  for (size_t i = 0; i < 10; i++) {
+    params.obj[i].type = OBJECT_TYPE_UINT;
+    params.obj[i].data.uinteger = uints[i];
+  }
+
+  for (size_t i = 0; i < 11; i++) {
+    params.obj[10 + i].type = OBJECT_TYPE_INT;
+    params.obj[10 + i].data.integer = ints[i];
+  }
+
+  for (size_t i = 0; i < 5; i++) {
+    params.obj[21 + i].type = OBJECT_TYPE_STR;
+    params.obj[21 + i].view = true;
+    params.obj[21 + i].data.string = (string) {.str = big,
+        .length = lengths[i]};
+  }
+
+  params.obj[26].type = OBJECT_TYPE_FLOAT;
+  params.obj[26].data.floating = 1.5;
+  params.obj[27].type = OBJECT_TYPE_NIL;
+  params.obj[28].type = OBJECT_TYPE_BOOL;
+  params.obj[28].data.boolean = true;
+  params.obj[29].type = OBJECT_TYPE_ARRAY;
+  params.obj[29].data.params = nested;
+  params.obj[30].type = OBJECT_TYPE_RAW;
+  params.obj[30].view = true;
+  params.obj[30].data.string = (string) {.str = "\x92\x01\xc0", .length = 3};
+
+  /* the precomputed sizes match what msgpack-c encodes */
+  msgpack_sbuffer_init(&sbuf);
+  msgpack_packer_init(&pk, &sbuf, msgpack_sbuffer_write);
+  assert_int_equal(0, pack_params(&pk, params));
+  assert_int_equal(sbuf.size, pack_params_size(params));
+  msgpack_sbuffer_clear(&sbuf);
+
+  request.msgid = 70000;
+  request.method = (string) {.str = "run", .length = 3};
+  request.params = params;
+  assert_int_equal(0, message_serialize_request(&request, &pk));
+  assert_int_equal(sbuf.size, message_serialize_request_size(&request));
+
+  /* and the message is encoded into a buffer of exactly that size */
+  buffer.size = sbuf.size;
+  buffer.used = 0;
+  buffer.data = MALLOC_ARRAY(buffer.size, char);
+  assert_non_null(buffer.data);
+  msgpack_packer_init(&pk, &buffer, pack_buffer_write);
+  assert_int_equal(0, message_serialize_request(&request, &pk));
+  assert_int_equal(buffer.size, buffer.used);
+  assert_memory_equal(sbuf.data, buffer.data, buffer.size);
+  FREE(buffer.data);
+  msgpack_sbuffer_clear(&sbuf);
+
+  response.msgid = 5;
+  response.params = params;
+  msgpack_packer_init(&pk, &sbuf, msgpack_sbuffer_write);
+  assert_int_equal(0, message_serialize_response(&response, &pk));
+  assert_int_equal(sbuf.size, message_serialize_response_size(&response));
+
+  /* a buffer that is too small isn't overrun */
+  buffer = (struct pack_buffer) {.data = small, .size = sizeof(small)};
+  assert_int_equal(0, pack_buffer_write(&buffer, "abc", 3));
+  assert_int_equal(-1, pack_buffer_write(&buffer, "de", 2));
+  assert_int_equal(3, buffer.used);
+
+  msgpack_sbuffer_destroy(&sbuf);
+  free_params(params);
+  FREE(big);
+}
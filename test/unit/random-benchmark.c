@@ -0,0 +1,48 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sb-common.h"
+#include "tweetnacl.h"
+#include "helper-unix.h"
+
+#define CALLS 100000
+
+/* 32 bytes is what a minute key or randommod() asks for */
+static double calls_per_second(void (*fill)(unsigned char *,
+    unsigned long long))
+{
+  unsigned char buf[32];
+  uint64_t start, elapsed;
+
+  start = uv_hrtime();
+
+  for (int i = 0; i < CALLS; i++)
+    fill(buf, sizeof(buf));
+
+  elapsed = uv_hrtime() - start;
+
+  return (CALLS * 1e9 / (double)(elapsed ? elapsed : 1));
+}
+
+void unit_random_benchmark(UNUSED(void **state))
+{
+  double kernel, drbg;
+
+  kernel = calls_per_second(devurandom_read);
+  drbg = calls_per_second(randombytes);
+
+  LOG("randombytes: kernel %.0f, drbg %.0f calls/s\n", kernel, drbg);
+}
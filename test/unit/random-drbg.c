@@ -0,0 +1,79 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sb-common.h"
+#include "tweetnacl.h"
+#include "drbg.h"
+#include "helper-unix.h"
+
+/* RFC 7539, section 2.3.2 */
+static const unsigned char expected[DRBG_BLOCK_SIZE] = {
+  0x10, 0xf1, 0xe7, 0xe4, 0xd1, 0x3b, 0x59, 0x15, 0x50, 0x0f, 0xdd, 0x1f,
+  0xa3, 0x20, 0x71, 0xc4, 0xc7, 0xd1, 0xf4, 0xc7, 0x33, 0xc0, 0x68, 0x03,
+  0x04, 0x22, 0xaa, 0x9a, 0xc3, 0xd4, 0x6c, 0x4e, 0xd2, 0x82, 0x64, 0x46,
+  0x07, 0x9f, 0xaa, 0x09, 0x14, 0xc2, 0xd7, 0x05, 0xd9, 0x8b, 0x02, 0xa2,
+  0xb5, 0x12, 0x9c, 0xd1, 0xde, 0x16, 0x4e, 0xb9, 0xcb, 0xd0, 0x83, 0xe8,
+  0xa2, 0x50, 0x3c, 0x4e
+};
+
+void unit_random_drbg(UNUSED(void **state))
+{
+  unsigned char key[32], block[DRBG_BLOCK_SIZE];
+  unsigned char nonce[12] = {
+    0x00, 0x00, 0x00, 0x09, 0x00, 0x00, 0x00, 0x4a, 0x00, 0x00, 0x00, 0x00
+  };
+  unsigned char a[4096], b[4096], child[32];
+  int fds[2];
+  pid_t pid;
+
+  for (int i = 0; i < 32; i++)
+    key[i] = (unsigned char)i;
+
+  chacha20_block(block, key, 1, nonce);
+  assert_memory_equal(expected, block, sizeof(block));
+
+  /* consecutive outputs, also across refills of the buffer */
+  randombytes(a, sizeof(a));
+  randombytes(b, sizeof(b));
+  assert_memory_not_equal(a, b, sizeof(a));
+
+  for (int i = 0; i < 64; i++) {
+    randombytes(a, 31);
+    randombytes(b, 31);
+    assert_memory_not_equal(a, b, 31);
+  }
+
+  /* parent and child don't share their output after a fork */
+  assert_int_equal(0, pipe(fds));
+  pid = fork();
+  assert_true(pid >= 0);
+
+  if (pid == 0) {
+    randombytes(child, sizeof(child));
+    _exit(write(fds[1], child, sizeof(child)) == sizeof(child) ? 0 : 1);
+  }
+
+  randombytes(a, sizeof(child));
+  assert_int_equal(sizeof(child), read(fds[0], child, sizeof(child)));
+  assert_int_equal(pid, waitpid(pid, NULL, 0));
+  assert_memory_not_equal(a, child, sizeof(child));
+
+  close(fds[0]);
+  close(fds[1]);
+}
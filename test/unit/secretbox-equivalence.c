@@ -0,0 +1,89 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "sb-common.h"
+#include "tweetnacl.h"
+#include "secretbox.h"
+#include "helper-unix.h"
+
+#define MAXLEN 2048
+#define ROUNDS 256
+
+typedef int (*salsa20_xor)(unsigned char *c, const unsigned char *m,
+    unsigned long long b, const unsigned char *n, const unsigned char *k);
+
+static void check_salsa20(salsa20_xor impl, const unsigned char *m,
+    unsigned long long len, const unsigned char *n, const unsigned char *k)
+{
+  unsigned char expected[MAXLEN], actual[MAXLEN];
+
+  crypto_stream_salsa20_xor_ref(expected, m, len, n, k);
+  assert_int_equal(0, impl(actual, m, len, n, k));
+  assert_memory_equal(expected, actual, len);
+
+  /* in place */
+  memcpy(actual, m, len);
+  assert_int_equal(0, impl(actual, actual, len, n, k));
+  assert_memory_equal(expected, actual, len);
+
+  /* bare keystream */
+  crypto_stream_salsa20_xor_ref(expected, NULL, len, n, k);
+  assert_int_equal(0, impl(actual, NULL, len, n, k));
+  assert_memory_equal(expected, actual, len);
+}
+
+void unit_secretbox_equivalence(UNUSED(void **state))
+{
+  unsigned char m[MAXLEN], k[32], n[8];
+  unsigned char expected[16], actual[16];
+  unsigned long long len;
+  uint16_t r;
+
+  for (int i = 0; i < ROUNDS; i++) {
+    randombytes((unsigned char *)&r, sizeof(r));
+    len = r % MAXLEN;
+
+    randombytes(m, len);
+    randombytes(k, sizeof(k));
+    randombytes(n, sizeof(n));
+
+    check_salsa20(salsa20_xor_portable, m, len, n, k);
+
+    if (cpu_supports_sse2())
+      check_salsa20(salsa20_xor_sse2, m, len, n, k);
+
+    if (cpu_supports_avx2())
+      check_salsa20(salsa20_xor_avx2, m, len, n, k);
+
+    crypto_onetimeauth_ref(expected, m, len, k);
+    assert_int_equal(0, poly1305_donna(actual, m, len, k));
+    assert_memory_equal(expected, actual, 16);
+  }
+
+  /* a key and message of all ones stress the final carries */
+  memset(k, 0xff, sizeof(k));
+  memset(m, 0xff, MAXLEN);
+
+  for (len = 0; len < 64; len++) {
+    crypto_onetimeauth_ref(expected, m, len, k);
+    assert_int_equal(0, poly1305_donna(actual, m, len, k));
+    assert_memory_equal(expected, actual, 16);
+  }
+
+  /* the selection always names an implementation */
+  secretbox_init();
+  assert_non_null(secretbox_implementation());
+}
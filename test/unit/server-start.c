@@ -23,7 +23,6 @@
 #include "helper-unix.h"
 #include "rpc/db/sb-db.h"
 
-uv_loop_t loop;
 
 void unit_server_start(UNUSED(void **state))
 {
@@ -20,7 +20,6 @@
 #include "helper-unix.h"
 #include "rpc/db/sb-db.h"
 
-uv_loop_t loop;
 
 void unit_server_stop(UNUSED(void **state))
 {
@@ -0,0 +1,78 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "sb-common.h"
+#include "helper-unix.h"
+
+struct object {
+  uint64_t id;
+  unsigned char payload[40];
+};
+
+void unit_slab_alloc(UNUSED(void **state))
+{
+  slab objects = SLAB_INIT("object", struct object);
+  struct object *o[100], *reused;
+
+  for (int i = 0; i < 100; i++) {
+    o[i] = slab_alloc(&objects);
+    assert_non_null(o[i]);
+    assert_int_equal(0, (uintptr_t)o[i] % 16);
+    o[i]->id = (uint64_t)i;
+    memset(o[i]->payload, i, sizeof(o[i]->payload));
+
+    for (int j = 0; j < i; j++)
+      assert_true(o[i] != o[j]);
+  }
+
+  for (int i = 0; i < 100; i++)
+    assert_int_equal(i, o[i]->id);
+
+  assert_int_equal(100, objects.stats.allocs);
+  assert_int_equal(100, objects.stats.inuse);
+  assert_int_equal(100, objects.stats.peak);
+  assert_int_equal(1, objects.stats.chunks);
+
+  /* the object freed last is handed out first */
+  slab_free(&objects, o[42]);
+  assert_int_equal(99, objects.stats.inuse);
+  reused = slab_alloc(&objects);
+  assert_ptr_equal(o[42], reused);
+
+  for (int i = 0; i < 100; i++)
+    slab_free(&objects, o[i]);
+
+  assert_int_equal(0, objects.stats.inuse);
+  assert_int_equal(100, objects.stats.peak);
+
+  /* prewarming only allocates what is missing */
+  slab_destroy(&objects);
+  assert_int_equal(0, objects.stats.available);
+  assert_int_equal(0, slab_prewarm(&objects, 10));
+  assert_int_equal(10, objects.stats.available);
+  assert_int_equal(0, slab_prewarm(&objects, 4));
+  assert_int_equal(1, objects.stats.chunks);
+
+  for (int i = 0; i < 10; i++)
+    o[i] = slab_alloc(&objects);
+
+  assert_int_equal(1, objects.stats.chunks);
+  assert_non_null(slab_alloc(&objects));
+  assert_int_equal(2, objects.stats.chunks);
+
+  slab_destroy(&objects);
+}
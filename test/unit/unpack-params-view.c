@@ -0,0 +1,141 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <msgpack.h>
+#include <string.h>
+
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "rpc/msgpack/sb-msgpack-rpc.h"
+#include "helper-unix.h"
+
+#define LARGE_SIZE 4096
+
+void unit_unpack_params_view(UNUSED(void **state))
+{
+  msgpack_sbuffer sbuf;
+  msgpack_packer pk;
+  msgpack_unpacked result;
+  struct message_object copy;
+  struct unpack_zone *zone;
+  struct unpack_options opts = {NULL, 0, STRING_INIT, 0};
+  arena *ar;
+  array params, forward;
+  char *large;
+  size_t off = 0;
+
+  large = MALLOC_ARRAY(LARGE_SIZE, char);
+  assert_non_null(large);
+  memset(large, 'x', LARGE_SIZE);
+
+  /* ["key", [<large bin>, 1]] */
+  msgpack_sbuffer_init(&sbuf);
+  msgpack_packer_init(&pk, &sbuf, msgpack_sbuffer_write);
+  msgpack_pack_array(&pk, 2);
+  msgpack_pack_str(&pk, 3);
+  msgpack_pack_str_body(&pk, "key", 3);
+  msgpack_pack_array(&pk, 2);
+  msgpack_pack_bin(&pk, LARGE_SIZE);
+  msgpack_pack_bin_body(&pk, large, LARGE_SIZE);
+  msgpack_pack_uint8(&pk, 1);
+
+  msgpack_unpacked_init(&result);
+  assert_int_equal(MSGPACK_UNPACK_SUCCESS,
+      msgpack_unpack_next(&result, sbuf.data, sbuf.size, &off));
+
+  /* threshold 0 copies everything */
+  assert_int_equal(0, unpack_params_view(&result.data, &params, NULL));
+  assert_false(params_have_views(params));
+  free_params(params);
+
+  /* only the large binary is a view */
+  opts.viewthreshold = 1024;
+  assert_int_equal(0, unpack_params_view(&result.data, &params, &opts));
+  assert_true(params_have_views(params));
+  assert_false(params.obj[0].view);
+  assert_string_equal("key", params.obj[0].data.string.str);
+  assert_true(params.obj[1].data.params.obj[0].view);
+  assert_ptr_equal(result.data.via.array.ptr[1].via.array.ptr[0].via.bin.ptr,
+      params.obj[1].data.params.obj[0].data.string.str);
+  assert_int_equal(LARGE_SIZE,
+      params.obj[1].data.params.obj[0].data.string.length);
+
+  /* copies of views are NUL-terminated and owned */
+  copy = message_object_copy(params.obj[1]);
+  assert_false(copy.data.params.obj[0].view);
+  assert_int_equal(LARGE_SIZE, copy.data.params.obj[0].data.string.length);
+  assert_int_equal('\0', copy.data.params.obj[0].data.string.str[LARGE_SIZE]);
+  assert_memory_equal(large, copy.data.params.obj[0].data.string.str,
+      LARGE_SIZE);
+  free_params(copy.data.params);
+
+  /* owning replaces the views in place */
+  assert_int_equal(0, message_object_own(&params.obj[1], NULL));
+  assert_false(params_have_views(params));
+  assert_true(result.data.via.array.ptr[1].via.array.ptr[0].via.bin.ptr !=
+      params.obj[1].data.params.obj[0].data.string.str);
+
+  /* borrowed arrays are left to their owner */
+  forward.size = 1;
+  forward.obj = CALLOC(1, struct message_object);
+  assert_non_null(forward.obj);
+  forward.obj[0] = message_object_borrow(params.obj[1]);
+  assert_ptr_equal(params.obj[1].data.params.obj,
+      forward.obj[0].data.params.obj);
+  free_params(forward);
+  assert_memory_equal(large, params.obj[1].data.params.obj[0].data.string.str,
+      LARGE_SIZE);
+
+  /* and copied when they have to outlive it */
+  forward.obj = CALLOC(1, struct message_object);
+  assert_non_null(forward.obj);
+  forward.obj[0] = message_object_borrow(params.obj[1]);
+  assert_int_equal(0, message_object_own(&forward.obj[0], NULL));
+  assert_false(forward.obj[0].view);
+  assert_true(params.obj[1].data.params.obj !=
+      forward.obj[0].data.params.obj);
+  free_params(params);
+  assert_memory_equal(large, forward.obj[0].data.params.obj[0].data.string.str,
+      LARGE_SIZE);
+  free_params(forward);
+
+  /* with an arena, the copies are taken from it */
+  ar = arena_new(NULL);
+  assert_non_null(ar);
+  opts.arena = ar;
+  assert_int_equal(0, unpack_params_view(&result.data, &params, &opts));
+  assert_true(params.obj[1].data.params.obj[0].view);
+  assert_int_equal(0, message_object_own(&params.obj[1], ar));
+  assert_false(params_have_views(params));
+  assert_memory_equal(large, params.obj[1].data.params.obj[0].data.string.str,
+      LARGE_SIZE);
+  assert_true(ar->used > LARGE_SIZE);
+  arena_free(ar);
+
+  /* the zone is freed with its last reference */
+  zone = unpack_zone_new(msgpack_unpacked_release_zone(&result));
+  assert_non_null(zone);
+  unpack_zone_ref(zone);
+  assert_int_equal(2, zone->refcount);
+  unpack_zone_unref(zone);
+  assert_int_equal(1, zone->refcount);
+  unpack_zone_unref(zone);
+  unpack_zone_unref(NULL);
+
+  msgpack_unpacked_destroy(&result);
+  msgpack_sbuffer_destroy(&sbuf);
+  FREE(large);
+}
@@ -0,0 +1,128 @@
+/**
+ *    Copyright (C) 2016 splone UG
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <msgpack.h>
+#include <string.h>
+
+#include "sb-common.h"
+#include "rpc/sb-rpc.h"
+#include "rpc/msgpack/sb-msgpack-rpc.h"
+#include "helper-unix.h"
+
+static void pack_args(msgpack_packer *pk)
+{
+  msgpack_pack_array(pk, 8);
+  msgpack_pack_uint8(pk, 7);
+  msgpack_pack_int64(pk, -300);
+  msgpack_pack_int32(pk, 70000);
+  msgpack_pack_str(pk, 3);
+  msgpack_pack_str_body(pk, "abc", 3);
+  msgpack_pack_array(pk, 2);
+  msgpack_pack_uint8(pk, 1);
+  msgpack_pack_map(pk, 1);
+  msgpack_pack_nil(pk);
+  msgpack_pack_nil(pk);
+  msgpack_pack_true(pk);
+  msgpack_pack_nil(pk);
+  msgpack_pack_double(pk, 1.5);
+}
+
+void unit_unpack_raw(UNUSED(void **state))
+{
+  msgpack_sbuffer sbuf, args, forwarded;
+  msgpack_packer pk;
+  msgpack_unpacked result;
+  struct unpack_options opts = {NULL, 0, STRING_INIT, 2};
+  array params, headers;
+  string raw, param;
+  size_t off = 0;
+
+  /* [0, 1, "run", [["key", nil], "fn", args]] */
+  msgpack_sbuffer_init(&sbuf);
+  msgpack_packer_init(&pk, &sbuf, msgpack_sbuffer_write);
+  msgpack_pack_array(&pk, 4);
+  msgpack_pack_uint8(&pk, 0);
+  msgpack_pack_uint32(&pk, 1);
+  msgpack_pack_str(&pk, 3);
+  msgpack_pack_str_body(&pk, "run", 3);
+  msgpack_pack_array(&pk, 3);
+  msgpack_pack_array(&pk, 2);
+  msgpack_pack_str(&pk, 3);
+  msgpack_pack_str_body(&pk, "key", 3);
+  msgpack_pack_nil(&pk);
+  msgpack_pack_str(&pk, 2);
+  msgpack_pack_str_body(&pk, "fn", 2);
+  pack_args(&pk);
+
+  msgpack_sbuffer_init(&args);
+  msgpack_packer_init(&pk, &args, msgpack_sbuffer_write);
+  pack_args(&pk);
+
+  raw = (string) {.str = sbuf.data, .length = sbuf.size};
+
+  /* the arguments are found by the headers of the elements before them */
+  assert_int_equal(0, unpack_raw_param(raw, 2, &param));
+  assert_int_equal(args.size, param.length);
+  assert_memory_equal(args.data, param.str, args.size);
+  assert_int_not_equal(0, unpack_raw_param(raw, 3, &param));
+  raw.length--;
+  assert_int_not_equal(0, unpack_raw_param(raw, 2, &param));
+  raw.length++;
+
+  /* top level types and numbers, nothing nested */
+  assert_int_equal(0, unpack_raw_params(param, &headers));
+  assert_int_equal(8, headers.size);
+  assert_int_equal(OBJECT_TYPE_UINT, headers.obj[0].type);
+  assert_int_equal(7, headers.obj[0].data.uinteger);
+  assert_int_equal(OBJECT_TYPE_INT, headers.obj[1].type);
+  assert_int_equal(-300, headers.obj[1].data.integer);
+  assert_int_equal(OBJECT_TYPE_UINT, headers.obj[2].type);
+  assert_int_equal(70000, headers.obj[2].data.uinteger);
+  assert_int_equal(OBJECT_TYPE_STR, headers.obj[3].type);
+  assert_int_equal(OBJECT_TYPE_ARRAY, headers.obj[4].type);
+  assert_int_equal(OBJECT_TYPE_BOOL, headers.obj[5].type);
+  assert_true(headers.obj[5].data.boolean);
+  assert_int_equal(OBJECT_TYPE_NIL, headers.obj[6].type);
+  assert_int_equal(OBJECT_TYPE_FLOAT, headers.obj[7].type);
+  free_params(headers);
+
+  /* the decoded request keeps the arguments encoded */
+  msgpack_unpacked_init(&result);
+  assert_int_equal(MSGPACK_UNPACK_SUCCESS,
+      msgpack_unpack_next(&result, sbuf.data, sbuf.size, &off));
+
+  opts.raw = raw;
+  assert_int_equal(0, unpack_params_view(&result.data.via.array.ptr[3],
+      &params, &opts));
+  assert_int_equal(OBJECT_TYPE_ARRAY, params.obj[0].type);
+  assert_int_equal(OBJECT_TYPE_STR, params.obj[1].type);
+  assert_int_equal(OBJECT_TYPE_RAW, params.obj[2].type);
+  assert_true(params.obj[2].view);
+  assert_ptr_equal(param.str, params.obj[2].data.string.str);
+
+  /* and forwards them as they are */
+  msgpack_sbuffer_init(&forwarded);
+  msgpack_packer_init(&pk, &forwarded, msgpack_sbuffer_write);
+  assert_int_equal(0, pack_params(&pk, params));
+  assert_memory_equal(forwarded.data + forwarded.size - args.size, args.data,
+      args.size);
+  free_params(params);
+
+  msgpack_sbuffer_destroy(&forwarded);
+  msgpack_unpacked_destroy(&result);
+  msgpack_sbuffer_destroy(&args);
+  msgpack_sbuffer_destroy(&sbuf);
+}